@@ -17,6 +17,7 @@
 #include <QSlider>
 #include <QVBoxLayout>
 #include "image_processor.h"
+#include "server.h"
 
 namespace fbiu {
 
@@ -54,6 +55,13 @@ private slots:
     void switch_language(const QString& lang);
     void retranslate_ui();
     
+    // Run a folder batch on fbiu_server (FBIU_SERVER), polling its progress
+    bool run_on_server(ServerClient& client, const ImageProcessor::BatchOptions& options);
+    
+    // Run a folder batch in this process on a background thread, polling its
+    // progress counters on a timer
+    bool run_locally(ImageProcessor::BatchOptions options);
+    
     // Custom parameter functions
     void setup_custom_param_ui(QVBoxLayout* main_layout);
     void update_custom_param_visibility();
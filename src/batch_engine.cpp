@@ -0,0 +1,149 @@
+#include "batch_engine.h"
+#include "cpu_topology.h"
+
+#include <algorithm>
+
+namespace fbiu {
+
+namespace {
+
+// Throughput changes smaller than this are treated as noise
+constexpr double ADAPTIVE_NOISE = 0.03;
+
+// Intervals the limits are kept after a move had to be undone (a settled
+// setting is probed again after this, in case the workload changed)
+constexpr int ADAPTIVE_HOLD = 20;
+
+// Move `value` one step in `direction` within [low, high]; at a bound the
+// direction turns around
+int step_limit(int value, int& direction, int low, int high, int step) {
+    int next = std::clamp(value + direction * step, low, high);
+    if (next == value) {
+        direction = -direction;
+        next = std::clamp(value + direction * step, low, high);
+    }
+    return next;
+}
+
+} // namespace
+
+int BatchEngine::resolve_thread_count(int requested) {
+    if (requested > 0) return requested;
+    int hardware = static_cast<int>(std::thread::hardware_concurrency());
+    return hardware > 0 ? hardware : 4;
+}
+
+BatchEngine::BatchEngine(int num_threads, int io_queue_depth, bool pin_threads)
+    : adaptive(num_threads == ADAPTIVE_THREADS),
+      worker_pool(static_cast<size_t>(adaptive ? resolve_thread_count(0) * ADAPTIVE_MAX_THREAD_FACTOR
+                                               : resolve_thread_count(num_threads)),
+                  pin_threads ? CpuTopology::system().placement() : std::vector<int>{}),
+      file_io(io_queue_depth > 0 ? static_cast<unsigned>(io_queue_depth) : DEFAULT_IO_QUEUE_DEPTH) {
+    if (adaptive) {
+        worker_pool.set_active_limit(static_cast<size_t>(resolve_thread_count(0)));
+        file_io.set_queue_depth(std::max(1u, file_io.max_queue_depth() / 2));
+        controller = std::thread(&BatchEngine::control_loop, this);
+    }
+}
+
+BatchEngine::~BatchEngine() {
+    if (controller.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+            stopping = true;
+        }
+        control_condition.notify_all();
+        controller.join();
+    }
+}
+
+void BatchEngine::control_loop() {
+    enum class Stage { NONE, WORKERS, IO };
+    using clock = std::chrono::steady_clock;
+
+    const int max_workers = static_cast<int>(worker_pool.size());
+    const int max_depth = static_cast<int>(file_io.max_queue_depth());
+    int worker_direction = 1;
+    int io_direction = 1;
+    Stage last_move = Stage::NONE;  // Stage moved at the end of the previous interval
+    int previous_limit = 0;         // Its limit before that move
+    double base_rate = 0.0;         // Files/s before that move (0: not measured yet)
+    int hold = 0;                   // Intervals left to keep the current limits
+
+    auto set_limit = [&](Stage stage, int value) {
+        if (stage == Stage::WORKERS) {
+            worker_pool.set_active_limit(static_cast<size_t>(value));
+        } else {
+            file_io.set_queue_depth(static_cast<unsigned>(value));
+        }
+    };
+
+    auto last_time = clock::now();
+    uint64_t last_files = files_done.load();
+    uint64_t last_queue_wait = worker_pool.total_queue_wait_ns();
+    uint64_t last_slot_wait = file_io.total_slot_wait_ns();
+
+    std::unique_lock<std::mutex> lock(control_mutex);
+    while (!control_condition.wait_for(lock, ADAPTIVE_INTERVAL, [this] { return stopping; })) {
+        const auto now = clock::now();
+        const uint64_t files = files_done.load();
+        const uint64_t queue_wait = worker_pool.total_queue_wait_ns();
+        const uint64_t slot_wait = file_io.total_slot_wait_ns();
+        const double seconds = std::chrono::duration<double>(now - last_time).count();
+        const uint64_t finished = files - last_files;
+        const uint64_t queue_waited = queue_wait - last_queue_wait;
+        const uint64_t slot_waited = slot_wait - last_slot_wait;
+        last_time = now;
+        last_files = files;
+        last_queue_wait = queue_wait;
+        last_slot_wait = slot_wait;
+
+        // Idle (or between batches): start measuring afresh next time
+        if (finished == 0) {
+            last_move = Stage::NONE;
+            base_rate = 0.0;
+            hold = 0;
+            continue;
+        }
+
+        const double rate = finished / seconds;
+        if (last_move != Stage::NONE) {
+            const Stage moved = last_move;
+            last_move = Stage::NONE;
+            if (rate <= base_rate * (1.0 + ADAPTIVE_NOISE)) {
+                // The move did not raise throughput: undo it, try the other
+                // direction next time and keep the limits for a while
+                set_limit(moved, previous_limit);
+                (moved == Stage::WORKERS ? worker_direction : io_direction) *= -1;
+                base_rate = 0.0;
+                hold = ADAPTIVE_HOLD;
+                continue;
+            }
+        }
+        if (hold > 0) {
+            --hold;
+            continue;
+        }
+        // First interval at these limits: measure before moving
+        if (base_rate == 0.0) {
+            base_rate = rate;
+            continue;
+        }
+        base_rate = rate;
+
+        // Step the stage whose callers waited longer
+        if (queue_waited >= slot_waited) {
+            const int workers = static_cast<int>(worker_pool.active_limit());
+            previous_limit = workers;
+            set_limit(Stage::WORKERS, step_limit(workers, worker_direction, 1, max_workers, std::max(1, workers / 8)));
+            last_move = Stage::WORKERS;
+        } else {
+            const int depth = static_cast<int>(file_io.queue_depth());
+            previous_limit = depth;
+            set_limit(Stage::IO, step_limit(depth, io_direction, 1, max_depth, std::max(1, depth / 4)));
+            last_move = Stage::IO;
+        }
+    }
+}
+
+} // namespace fbiu
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "thread_pool.h"
+#include "file_io.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace fbiu {
+
+// Thread count that selects adaptive concurrency (see BatchEngine)
+constexpr int ADAPTIVE_THREADS = -1;
+
+// Worker pool, asynchronous I/O backend and encode buffers that can outlive a
+// single batch. batch_process() creates a temporary engine per call; resident
+// processes (server, job lists) keep one engine warm and run every batch on it.
+//
+// With ADAPTIVE_THREADS the engine spawns up to ADAPTIVE_MAX_THREAD_FACTOR
+// workers per core but starts with one active worker per core and half the
+// I/O depth. A controller thread then hill-climbs toward the highest files/s:
+// every ADAPTIVE_INTERVAL it moves the stage whose callers waited longer
+// (tasks queued for a worker vs. requests blocked on a free I/O slot) one
+// step. A move that did not raise throughput is undone, its stage will try
+// the other direction, and the limits are then held for a while before the
+// controller probes again.
+class BatchEngine {
+public:
+    static constexpr int ADAPTIVE_MAX_THREAD_FACTOR = 4;
+    static constexpr std::chrono::milliseconds ADAPTIVE_INTERVAL{500};
+
+    // num_threads / io_queue_depth <= 0 select the defaults
+    // (num_threads == ADAPTIVE_THREADS: adaptive, io_queue_depth is the maximum).
+    // pin_threads places each worker on its own core, spread over the NUMA
+    // nodes (CpuTopology::placement); Linux only, ignored elsewhere.
+    explicit BatchEngine(int num_threads = 0, int io_queue_depth = 0, bool pin_threads = false);
+    ~BatchEngine();
+
+    ThreadPool& pool() { return worker_pool; }
+    AsyncFileIO& io() { return file_io; }
+    BufferPool& buffers() { return encode_buffers; }
+
+    // Workers currently allowed to run (changes over time when adaptive)
+    int thread_count() const { return static_cast<int>(worker_pool.active_limit()); }
+    bool is_adaptive() const { return adaptive; }
+
+    // Called by the pipelines once per finished input file (throughput signal)
+    void note_file_done() { files_done.fetch_add(1, std::memory_order_relaxed); }
+
+    // Resolve a requested thread count (0 = hardware concurrency)
+    static int resolve_thread_count(int requested);
+
+private:
+    void control_loop();
+
+    bool adaptive;
+    ThreadPool worker_pool;
+    AsyncFileIO file_io;
+    BufferPool encode_buffers;
+
+    std::atomic<uint64_t> files_done{0};
+    std::mutex control_mutex;
+    std::condition_variable control_condition;
+    bool stopping = false;
+    std::thread controller;
+};
+
+} // namespace fbiu
@@ -1,18 +1,219 @@
 #include "image_processor.h"
+#include "batch_engine.h"
+#include "trace.h"
+#include "progress.h"
+#include "frame_stream.h"
+#include "cpu_topology.h"
+#include "shard.h"
+#include "server.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <csignal>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+static std::atomic<bool> g_stop_requested{false};
+
+static void handle_stop_signal(int) {
+    g_stop_requested = true;
+}
+
+// Progress line, rewritten in place on a terminal (one line per sample
+// when stdout is redirected). Watch mode has no meaningful total.
+static void render_progress_line(const fbiu::ProgressReporter::Sample& sample, bool watch) {
+    static const bool terminal = isatty(fileno(stdout)) != 0;
+    std::ostringstream line;
+    line << "[" << sample.completed;
+    if (!watch) line << "/" << sample.total;
+    line << "] " << std::fixed << std::setprecision(1) << sample.files_per_second << " files/s, "
+         << sample.elapsed_seconds << " s";
+    if (terminal) {
+        std::cout << "\r" << std::left << std::setw(60) << line.str() << (sample.final ? "\n" : "") << std::flush;
+    } else {
+        std::cout << line.str() << "\n";
+    }
+}
+
+// One JSON object per sample (NDJSON) for scripts and dashboards
+static void render_progress_json(std::ostream& out, const fbiu::ProgressReporter::Sample& sample) {
+    out << "{\"completed\":" << sample.completed << ",\"total\":" << sample.total << std::fixed
+        << std::setprecision(3) << ",\"elapsed\":" << sample.elapsed_seconds << std::setprecision(2)
+        << ",\"files_per_second\":" << sample.files_per_second
+        << ",\"final\":" << (sample.final ? "true" : "false") << "}\n";
+    out.flush();
+}
+
+// Stream mode: images from stdin, processed images to stdout in input order.
+// batch_process_memory overlaps reading, the decode/kernel/encode of several
+// frames and writing; finished frames wait in `ready` until every earlier
+// frame has been written. Nothing but frames goes to stdout.
+static int run_stream(const fbiu::ImageProcessor::BatchOptions& options, fbiu::StreamFraming framing) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    fbiu::FrameReader reader(stdin, framing);
+    uint64_t frames_read = 0;
+    
+    std::mutex write_mutex;
+    std::map<uint64_t, fbiu::ImageProcessor::MemoryResult> ready;
+    uint64_t next_to_write = 0;
+    int failed_frames = 0;
+    bool write_failed = false;
+    
+    fbiu::ImageProcessor::batch_process_memory(options,
+        [&](fbiu::ImageProcessor::MemoryItem& item) {
+            if (write_failed || !reader.next(item.encoded)) return false;
+            item.name = std::to_string(frames_read++);
+            return true;
+        },
+        [&](fbiu::ImageProcessor::MemoryResult&& result) {
+            std::lock_guard<std::mutex> lock(write_mutex);
+            ready.emplace(std::stoull(result.name), std::move(result));
+            for (auto it = ready.begin(); it != ready.end() && it->first == next_to_write; it = ready.erase(it)) {
+                const fbiu::ImageProcessor::MemoryResult& frame = it->second;
+                ++next_to_write;
+                if (!frame.ok) {
+                    // A concatenated stream cannot mark the gap; a length-prefixed one gets an empty frame
+                    std::cerr << "Frame " << it->first << " failed\n";
+                    ++failed_frames;
+                    if (framing == fbiu::StreamFraming::CONCATENATED) continue;
+                }
+                const size_t size = frame.ok ? frame.encoded.size() : 0;
+                if (!write_failed && !fbiu::write_frame(stdout, framing, frame.encoded.data(), size)) {
+                    std::cerr << "Error: Failed to write to stdout\n";
+                    write_failed = true;
+                }
+            }
+        });
+    
+    if (!reader.error().empty()) {
+        std::cerr << "Error: Frame " << frames_read << ": " << reader.error() << "\n";
+        return 1;
+    }
+    return failed_frames > 0 || write_failed ? 1 : 0;
+}
+
+// Submit the batch to fbiu_server and follow its progress
+static int run_on_server(const std::string& socket_path, const fbiu::ImageProcessor::BatchOptions& options) {
+    fbiu::ServerClient client;
+    if (!client.connect(socket_path)) {
+        std::cerr << "Error: " << client.last_error() << "\n";
+        return 1;
+    }
+    
+    int job = client.submit(options);
+    if (job < 0) {
+        std::cerr << "Error: " << client.last_error() << "\n";
+        return 1;
+    }
+    std::cout << "Submitted job " << job << " to " << socket_path << "\n";
+    
+    std::signal(SIGINT, handle_stop_signal);
+    bool cancel_sent = false;
+    fbiu::JobStatus status;
+    int last_completed = -1;
+    while (client.status(job, status)) {
+        if (g_stop_requested && !cancel_sent) {
+            client.cancel(job);
+            cancel_sent = true;
+        }
+        if (status.completed != last_completed && status.total > 0) {
+            std::cout << "[" << status.completed << "/" << status.total << "] " << status.state << std::endl;
+            last_completed = status.completed;
+        }
+        if (status.state != "queued" && status.state != "running") break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    
+    if (status.state == "done") {
+        std::cout << "\nBatch processing completed successfully\n";
+        return 0;
+    }
+    std::cerr << "\nBatch processing " << (status.state.empty() ? "failed: " + client.last_error() : status.state) << "\n";
+    return 1;
+}
 
 void print_usage() {
     std::cout << "Fast Batch Image Utility - CLI Mode\n";
     std::cout << "Usage: fbiu_cli --input <dir> --output <dir> --function <func> [--threads <n>]\n";
+    std::cout << "       fbiu_cli --stream <concat|length> --function <func> < in > out\n";
+    std::cout << "       fbiu_cli --jobs <jobs.csv> [--threads <n>]\n";
     std::cout << "\nOptions:\n";
     std::cout << "  --input <dir>      Input directory containing images\n";
     std::cout << "  --output <dir>     Output directory for processed images\n";
     std::cout << "  --function <func>  Processing function:\n";
     std::cout << "                     luma2alpha  - Convert luminance to transparency (alpha)\n";
+    std::cout << "                     luma2alpha_custom - The same with --luma-weights /\n";
+    std::cout << "                                   --linear-light\n";
     std::cout << "                     png         - Convert to PNG format\n";
-    std::cout << "  --threads <n>      Number of threads (default: auto)\n";
+    std::cout << "  --threshold <n>    luma2alpha threshold 0-255 (default: 200), or 'auto' to pick\n";
+    std::cout << "                     it per image from the luminance histogram (Otsu)\n";
+    std::cout << "  --luma-weights <w> luma2alpha_custom weights: bt601 (default), bt709 or R,G,B\n";
+    std::cout << "  --linear-light     luma2alpha_custom: decode sRGB to linear light before\n";
+    std::cout << "                     weighting (luminance and threshold are linear Y)\n";
+    std::cout << "  --output-format <fmt>  Output file format: png (default), qoi, raw (.fbraw)\n";
+    std::cout << "  --keep-rgba        Always write RGBA PNGs (no gray+alpha / indexed output)\n";
+    std::cout << "  --trim             Crop outputs to their visible pixels; offsets go to\n";
+    std::cout << "                     trim_manifest.csv in the output directory (luma2alpha)\n";
+    std::cout << "  --report           Write per-file threshold, alpha coverage and mean luminance\n";
+    std::cout << "                     to report.csv in the output directory (luma2alpha)\n";
+    std::cout << "  --proxies <N,...>  Also write every output at 1/N size as <name>_proxyN\n";
+    std::cout << "                     (e.g. 2,4 = half and quarter resolution)\n";
+    std::cout << "  --proxy-filter <f> Proxy resampling: box (default, area average) or lanczos\n";
+    std::cout << "  --target <spec>    Extra output from the same decode (repeatable). Spec is\n";
+    std::cout << "                     key=value pairs joined by commas; output=<dir> is required,\n";
+    std::cout << "                     other keys default to the main output's settings:\n";
+    std::cout << "                     function, threshold, output_format, keep_rgba, trim\n";
+    std::cout << "                     e.g. --target output=out_png,function=png\n";
+    std::cout << "  --threads <n>      Number of threads (default: auto; adaptive = tune\n";
+    std::cout << "                     workers and I/O depth while running)\n";
+    std::cout << "  --io-depth <n>     Files kept in flight by async I/O (default: 128)\n";
+    std::cout << "  --pin-threads      Pin each worker to a core, spread over the NUMA nodes, so\n";
+    std::cout << "                     its frame buffers stay in node-local memory (Linux)\n";
+    std::cout << "  --shard <i/N>      Process only shard i of N (partitioned by file name hash)\n";
+    std::cout << "  --claim-dir <dir>  Shared directory used to split work between processes\n";
+    std::cout << "  --watch            Keep running and process files as they land in the input\n";
+    std::cout << "                     directory (Linux only, stop with Ctrl+C)\n";
+    std::cout << "  --settle-ms <n>    Watch mode: quiet period after a file is closed (default: 500)\n";
+    std::cout << "  --force-reencode   With png: decode and re-encode PNG inputs instead of copying\n";
+    std::cout << "  --drop-cache       Evict inputs and outputs from the page cache once done\n";
+    std::cout << "  --journal          Record finished outputs in fbiu_journal.log in the output\n";
+    std::cout << "                     directory (fsynced in batches; Ctrl+C stops cleanly)\n";
+    std::cout << "  --resume           Skip inputs a journaled run already finished; the last\n";
+    std::cout << "                     entries are verified against their files (implies --journal)\n";
+    std::cout << "  --progress-json <file>  Append progress samples as NDJSON (4 per second)\n";
+    std::cout << "  --trace <file>     Write a Chrome Trace Event JSON timeline of the run\n";
+    std::cout << "                     (open in ui.perfetto.dev)\n";
+    std::cout << "  --stream <framing> Read images from stdin and write the results to stdout in\n";
+    std::cout << "                     order (no --input/--output). concat: images back to back\n";
+    std::cout << "                     (PNG, JPEG, BMP, QOI, fbraw); length: each preceded by a\n";
+    std::cout << "                     4-byte big-endian size (any format, 0 = failed frame)\n";
+    std::cout << "  --jobs <file>      Run every job of a CSV job list on one shared pool (no\n";
+    std::cout << "                     --input/--output). The header names the columns: input\n";
+    std::cout << "                     plus --target keys; other options are the jobs' defaults\n";
+    std::cout << "                     e.g. input,output,function,threshold\n";
+    std::cout << "  --server <socket>  Submit the batch to a running fbiu_server instead\n";
     std::cout << "  --help             Show this help message\n";
 }
 
@@ -23,6 +224,10 @@ int main(int argc, char* argv[]) {
     }
     
     std::map<std::string, std::string> args;
+    std::vector<std::string> target_specs;  // --target may be given several times
+    // Options that take no value
+    const std::set<std::string> flags = {"watch", "force-reencode", "keep-rgba", "trim", "report", "drop-cache",
+                                         "pin-threads", "journal", "resume", "linear-light"};
     
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -32,6 +237,16 @@ int main(int argc, char* argv[]) {
             return 0;
         }
         
+        if (arg == "--target" && i + 1 < argc) {
+            target_specs.push_back(argv[++i]);
+            continue;
+        }
+        
+        if (arg.substr(0, 2) == "--" && flags.count(arg.substr(2))) {
+            args.emplace(arg.substr(2), "1");
+            continue;
+        }
+        
         if (arg.substr(0, 2) == "--" && i + 1 < argc) {
             std::string key = arg.substr(2);
             std::string value = argv[i + 1];
@@ -40,14 +255,23 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    // Validate required arguments
-    if (args.find("input") == args.end() || 
-        args.find("output") == args.end() || 
+    // Validate required arguments (stream mode has no directories; a job
+    // list gives them per job and defaults to luma2alpha)
+    const bool stream = args.find("stream") != args.end();
+    const bool job_list = args.find("jobs") != args.end();
+    if (job_list && args.find("function") == args.end()) {
+        args["function"] = "luma2alpha";
+    }
+    if ((!stream && !job_list && (args.find("input") == args.end() || args.find("output") == args.end())) ||
         args.find("function") == args.end()) {
         std::cerr << "Error: Missing required arguments\n\n";
         print_usage();
         return 1;
     }
+    if (job_list && (stream || args.find("watch") != args.end() || args.find("server") != args.end())) {
+        std::cerr << "Error: --jobs cannot be combined with --stream, --watch or --server\n";
+        return 1;
+    }
     
     // Parse function
     fbiu::ProcessFunction func;
@@ -55,6 +279,8 @@ int main(int argc, char* argv[]) {
     
     if (func_str == "luma2alpha") {
         func = fbiu::ProcessFunction::LUMA_TO_ALPHA;
+    } else if (func_str == "luma2alpha_custom") {
+        func = fbiu::ProcessFunction::LUMA_TO_ALPHA_CUSTOM;
     } else if (func_str == "png") {
         func = fbiu::ProcessFunction::CONVERT_TO_PNG;
     } else {
@@ -62,37 +288,279 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Parse output format
+    fbiu::OutputFormat output_format = fbiu::OutputFormat::PNG;
+    if (args.find("output-format") != args.end() &&
+        !fbiu::ImageProcessor::parse_output_format(args["output-format"], output_format)) {
+        std::cerr << "Error: Unknown output format '" << args["output-format"] << "'\n";
+        return 1;
+    }
+    
+    // Parse threshold
+    uint8_t threshold = fbiu::DEFAULT_LUMA_THRESHOLD;
+    bool auto_threshold = false;
+    if (args.find("threshold") != args.end()) {
+        if (args["threshold"] == "auto") {
+            auto_threshold = true;
+        } else {
+            int value = -1;
+            try {
+                value = std::stoi(args["threshold"]);
+            } catch (...) {
+            }
+            if (value < 0 || value > 255) {
+                std::cerr << "Error: Invalid threshold '" << args["threshold"] << "' (0-255 or auto)\n";
+                return 1;
+            }
+            threshold = static_cast<uint8_t>(value);
+        }
+    }
+    
+    // Parse luminance weights and transfer (job lists apply them to their
+    // luma2alpha_custom jobs)
+    fbiu::CustomLumaParams luma_params;
+    if (args.find("luma-weights") != args.end() &&
+        !fbiu::ImageProcessor::parse_luma_weights(args["luma-weights"], luma_params)) {
+        std::cerr << "Error: Invalid luma weights '" << args["luma-weights"] << "' (bt601, bt709 or R,G,B)\n";
+        return 1;
+    }
+    luma_params.linear = args.find("linear-light") != args.end();
+    if (!job_list && func != fbiu::ProcessFunction::LUMA_TO_ALPHA_CUSTOM &&
+        (args.find("luma-weights") != args.end() || luma_params.linear)) {
+        std::cerr << "Error: --luma-weights and --linear-light need --function luma2alpha_custom\n";
+        return 1;
+    }
+    
     // Parse threads
     int threads = 0;
     if (args.find("threads") != args.end()) {
+        if (args["threads"] == "adaptive") {
+            threads = fbiu::ADAPTIVE_THREADS;
+        } else {
+            try {
+                threads = std::max(0, std::stoi(args["threads"]));
+            } catch (...) {
+                std::cerr << "Warning: Invalid thread count, using auto\n";
+                threads = 0;
+            }
+        }
+    }
+    
+    // Parse I/O queue depth
+    int io_depth = 0;
+    if (args.find("io-depth") != args.end()) {
         try {
-            threads = std::stoi(args["threads"]);
+            io_depth = std::stoi(args["io-depth"]);
         } catch (...) {
-            std::cerr << "Warning: Invalid thread count, using auto\n";
-            threads = 0;
+            std::cerr << "Warning: Invalid I/O depth, using default\n";
+            io_depth = 0;
         }
     }
     
+    // Parse proxies
+    std::vector<int> proxy_scales;
+    if (args.find("proxies") != args.end() &&
+        !fbiu::ImageProcessor::parse_proxy_scales(args["proxies"], proxy_scales)) {
+        std::cerr << "Error: Invalid proxy scales '" << args["proxies"] << "' (divisors 2-64, e.g. 2,4)\n";
+        return 1;
+    }
+    fbiu::ResizeFilter proxy_filter = fbiu::ResizeFilter::BOX;
+    if (args.find("proxy-filter") != args.end() && !fbiu::parse_resize_filter(args["proxy-filter"], proxy_filter)) {
+        std::cerr << "Error: Unknown proxy filter '" << args["proxy-filter"] << "' (box or lanczos)\n";
+        return 1;
+    }
+    
+    // Parse shard
+    fbiu::ShardSpec shard;
+    if (args.find("shard") != args.end() && !fbiu::ShardSpec::parse(args["shard"], shard)) {
+        std::cerr << "Error: Invalid shard '" << args["shard"] << "' (expected i/N)\n";
+        return 1;
+    }
+    
     // Setup batch options
     fbiu::ImageProcessor::BatchOptions options;
     options.input_dir = args["input"];
     options.output_dir = args["output"];
     options.function = func;
+    options.luma_threshold = threshold;
+    options.custom_params = luma_params;
+    options.custom_params.threshold = threshold;
+    options.auto_threshold = auto_threshold;
     options.num_threads = threads;
+    options.io_queue_depth = io_depth;
+    options.pin_threads = args.find("pin-threads") != args.end();
+    options.shard_index = shard.index;
+    options.shard_count = shard.count;
+    options.claim_dir = args["claim-dir"];
+    options.force_reencode = args.find("force-reencode") != args.end();
+    options.output_format = output_format;
+    options.keep_rgba = args.find("keep-rgba") != args.end();
+    options.trim = args.find("trim") != args.end();
+    options.report = args.find("report") != args.end();
+    options.drop_cache = args.find("drop-cache") != args.end();
+    options.resume = args.find("resume") != args.end();
+    options.journal = options.resume || args.find("journal") != args.end();
+    options.proxy_scales = proxy_scales;
+    options.proxy_filter = proxy_filter;
     
-    options.progress_callback = [](int completed, int total, const std::string& filename) {
-        std::cout << "[" << completed << "/" << total << "] Processing: " 
-                  << filename << std::endl;
+    // Extra outputs start from the main output's settings
+    for (const std::string& spec : target_specs) {
+        fbiu::ImageProcessor::OutputTarget target = options.main_target();
+        target.output_dir.clear();
+        if (!fbiu::ImageProcessor::parse_target_spec(spec, target) || target.output_dir.empty()) {
+            std::cerr << "Error: Invalid target '" << spec << "' (output=<dir> is required)\n";
+            return 1;
+        }
+        options.extra_targets.push_back(target);
+    }
+    
+    // Spans are kept in memory and written once the batch is over
+    std::unique_ptr<fbiu::Tracer> tracer;
+    if (args.find("trace") != args.end()) {
+        tracer = std::make_unique<fbiu::Tracer>();
+        options.tracer = tracer.get();
+    }
+    auto write_trace = [&](std::ostream& log) {
+        if (!tracer) return;
+        if (tracer->write_json(args["trace"])) {
+            log << "Trace written to " << args["trace"] << "\n";
+        } else {
+            std::cerr << "Failed to write trace: " << args["trace"] << "\n";
+        }
     };
     
+    if (stream) {
+        fbiu::StreamFraming framing;
+        if (!fbiu::parse_stream_framing(args["stream"], framing)) {
+            std::cerr << "Error: Unknown stream framing '" << args["stream"] << "' (concat or length)\n";
+            return 1;
+        }
+        int status = run_stream(options, framing);
+        write_trace(std::cerr);
+        return status;
+    }
+    
+    if (args.find("server") != args.end()) {
+        if (args.find("trace") != args.end()) {
+            std::cerr << "Warning: --trace is ignored with --server\n";
+        }
+        return run_on_server(args["server"], options);
+    }
+    
+    // Workers only bump counters; a reporter thread renders them at a fixed
+    // rate (job lists share one set of counters)
+    fbiu::BatchProgress progress;
+    options.progress = &progress;
+    
+    // A journaled run can be interrupted and resumed: stop taking new files
+    // and let the ones in flight finish and be recorded
+    if (options.journal && args.find("watch") == args.end()) {
+        options.cancel_flag = &g_stop_requested;
+        std::signal(SIGINT, handle_stop_signal);
+        std::signal(SIGTERM, handle_stop_signal);
+    }
+    
+    std::vector<fbiu::ImageProcessor::BatchOptions> jobs;
+    if (job_list && !fbiu::ImageProcessor::load_job_list(args["jobs"], options, jobs)) {
+        return 1;
+    }
+    
     // Execute
     std::cout << "Starting batch processing...\n";
-    std::cout << "Input:  " << options.input_dir << "\n";
-    std::cout << "Output: " << options.output_dir << "\n";
-    std::cout << "Function: " << func_str << "\n";
-    std::cout << "Threads: " << (threads > 0 ? std::to_string(threads) : "auto") << "\n\n";
+    if (job_list) {
+        std::cout << "Jobs:   " << jobs.size() << " from " << args["jobs"] << "\n";
+    } else {
+        std::cout << "Input:  " << options.input_dir << "\n";
+        std::cout << "Output: " << options.output_dir << "\n";
+        std::cout << "Function: " << func_str << "\n";
+        if (func == fbiu::ProcessFunction::LUMA_TO_ALPHA || func == fbiu::ProcessFunction::LUMA_TO_ALPHA_CUSTOM) {
+            std::cout << "Threshold: " << (auto_threshold ? std::string("auto") : std::to_string(threshold)) << "\n";
+        }
+        if (func == fbiu::ProcessFunction::LUMA_TO_ALPHA_CUSTOM) {
+            std::cout << "Luma weights: " << luma_params.coef_r << ", " << luma_params.coef_g << ", "
+                      << luma_params.coef_b << (luma_params.linear ? " (linear light)" : " (gamma-encoded)") << "\n";
+        }
+        std::cout << "Output format: " << fbiu::ImageProcessor::output_format_name(output_format) << "\n";
+    }
+    for (int scale : proxy_scales) {
+        std::cout << "Proxy:  1/" << scale << " (" << fbiu::resize_filter_name(proxy_filter) << ")\n";
+    }
+    for (const auto& target : options.extra_targets) {
+        std::cout << "Also:   " << target.output_dir << " ("
+                  << fbiu::ImageProcessor::function_name(target.function) << ", "
+                  << fbiu::ImageProcessor::output_format_name(target.output_format) << ")\n";
+    }
+    std::cout << "Threads: "
+              << (threads > 0 ? std::to_string(threads) : threads == fbiu::ADAPTIVE_THREADS ? "adaptive" : "auto")
+              << "\n";
+    if (options.pin_threads) {
+        const fbiu::CpuTopology& topology = fbiu::CpuTopology::system();
+        if (topology.placement().empty()) {
+            std::cerr << "Warning: --pin-threads is not supported here, workers are not pinned\n";
+        } else {
+            std::cout << "Pinned: " << topology.placement().size() << " CPUs on " << topology.nodes.size()
+                      << " NUMA node(s)\n";
+        }
+    }
+    if (shard.count > 1) {
+        std::cout << "Shard: " << shard.index << "/" << shard.count << "\n";
+    }
+    if (!options.claim_dir.empty()) {
+        std::cout << "Claim dir: " << options.claim_dir << "\n";
+    }
+    std::cout << "\n";
+    
+    const bool watch = args.find("watch") != args.end();
+    std::ofstream progress_json;
+    if (args.find("progress-json") != args.end()) {
+        progress_json.open(args["progress-json"], std::ios::app);
+        if (!progress_json) {
+            std::cerr << "Error: Cannot open progress file: " << args["progress-json"] << "\n";
+            return 1;
+        }
+    }
+    fbiu::ProgressReporter reporter(progress, std::chrono::milliseconds(250),
+                                    [&](const fbiu::ProgressReporter::Sample& sample) {
+        render_progress_line(sample, watch);
+        if (progress_json.is_open()) render_progress_json(progress_json, sample);
+    });
+    
+    bool success;
+    if (watch) {
+        int settle_ms = 500;
+        if (args.find("settle-ms") != args.end()) {
+            try {
+                settle_ms = std::stoi(args["settle-ms"]);
+            } catch (...) {
+                std::cerr << "Warning: Invalid settle time, using 500 ms\n";
+            }
+        }
+        
+        std::signal(SIGINT, handle_stop_signal);
+        std::signal(SIGTERM, handle_stop_signal);
+        std::cout << "Watching for new files (Ctrl+C to stop)...\n";
+        success = fbiu::ImageProcessor::watch_folder(options, g_stop_requested, settle_ms);
+    } else if (job_list) {
+        // One engine for the whole list: no per-job pool start-up
+        fbiu::BatchEngine engine(options.num_threads, options.io_queue_depth, options.pin_threads);
+        std::mutex failed_mutex;
+        std::vector<size_t> failed;
+        success = fbiu::ImageProcessor::batch_process_jobs(jobs, engine, [&](size_t index, bool ok) {
+            if (ok) return;
+            std::lock_guard<std::mutex> lock(failed_mutex);
+            failed.push_back(index);
+        });
+        std::sort(failed.begin(), failed.end());
+        for (size_t index : failed) {
+            std::cerr << "Job " << index + 1 << " failed: " << jobs[index].input_dir << " -> "
+                      << jobs[index].output_dir << "\n";
+        }
+    } else {
+        success = fbiu::ImageProcessor::batch_process(options);
+    }
+    reporter.stop();
     
-    bool success = fbiu::ImageProcessor::batch_process(options);
+    write_trace(std::cout);
     
     if (success) {
         std::cout << "\nBatch processing completed successfully\n";
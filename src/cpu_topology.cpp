@@ -0,0 +1,120 @@
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace fbiu {
+
+namespace {
+
+#ifdef __linux__
+
+// Parse a sysfs CPU list ("0-3,8-11"); empty if the file cannot be read
+std::vector<int> read_cpu_list(const std::string& path) {
+    std::vector<int> cpus;
+    std::ifstream in(path);
+    std::string list;
+    if (!in || !std::getline(in, list)) return cpus;
+
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        const std::string range = list.substr(start, end - start);
+        start = end + 1;
+        try {
+            const size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (...) {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+CpuTopology detect() {
+    CpuTopology topology;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return topology;
+
+    // Online nodes in order; a kernel without NUMA support has no node directory
+    std::vector<std::vector<int>> nodes;
+    for (int node : read_cpu_list("/sys/devices/system/node/online")) {
+        nodes.push_back(read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) nodes.back().push_back(cpu);
+        }
+    }
+
+    for (const std::vector<int>& node_cpus : nodes) {
+        std::vector<int> cores;
+        std::vector<int> siblings;
+        for (int cpu : node_cpus) {
+            if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) continue;
+            // The first CPU of a core's sibling list stands for the core
+            const std::vector<int> thread_siblings = read_cpu_list(
+                "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+            const bool primary = thread_siblings.empty() ||
+                                 *std::min_element(thread_siblings.begin(), thread_siblings.end()) == cpu;
+            (primary ? cores : siblings).push_back(cpu);
+        }
+        cores.insert(cores.end(), siblings.begin(), siblings.end());
+        if (!cores.empty()) topology.nodes.push_back(std::move(cores));
+    }
+    return topology;
+}
+
+#else
+
+CpuTopology detect() {
+    return CpuTopology{};
+}
+
+#endif
+
+} // namespace
+
+const CpuTopology& CpuTopology::system() {
+    static const CpuTopology topology = detect();
+    return topology;
+}
+
+std::vector<int> CpuTopology::placement() const {
+    std::vector<int> cpus;
+    size_t longest = 0;
+    for (const auto& node : nodes) longest = std::max(longest, node.size());
+    for (size_t i = 0; i < longest; ++i) {
+        for (const auto& node : nodes) {
+            if (i < node.size()) cpus.push_back(node[i]);
+        }
+    }
+    return cpus;
+}
+
+bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+} // namespace fbiu
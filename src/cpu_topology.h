@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+namespace fbiu {
+
+// NUMA nodes and the CPUs this process may run on (Linux sysfs and the
+// affinity mask; elsewhere, or when nothing can be read, one node with no
+// known CPUs, which disables pinning).
+struct CpuTopology {
+    // CPUs of each node, one per physical core first and their SMT siblings
+    // after, so the first workers of a node get a core each
+    std::vector<std::vector<int>> nodes;
+
+    // Detected once per process
+    static const CpuTopology& system();
+
+    // CPU for each worker slot: round-robin over the nodes, so any worker
+    // count is spread evenly across the sockets and each worker's memory
+    // (first touch) stays on its node. Empty if pinning is not available.
+    std::vector<int> placement() const;
+};
+
+// Restrict the calling thread to one CPU; false if the platform or the
+// affinity mask does not allow it
+bool pin_current_thread(int cpu);
+
+} // namespace fbiu
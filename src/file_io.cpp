@@ -0,0 +1,696 @@
+#include "file_io.h"
+#include "thread_pool.h"
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define FBIU_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace fbiu {
+
+bool AsyncFileIO::read_file_sync(const std::string& path, std::vector<uint8_t>& out) {
+    fs::path file_path(reinterpret_cast<const char8_t*>(path.c_str()));
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+
+    std::streamsize size = file.tellg();
+    if (size < 0) return false;
+    file.seekg(0, std::ios::beg);
+
+    out.resize(static_cast<size_t>(size));
+    return size == 0 || static_cast<bool>(file.read(reinterpret_cast<char*>(out.data()), size));
+}
+
+bool AsyncFileIO::read_file_prefix_sync(const std::string& path, size_t max_bytes, std::vector<uint8_t>& out) {
+    fs::path file_path(reinterpret_cast<const char8_t*>(path.c_str()));
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) return false;
+
+    out.resize(max_bytes);
+    file.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(max_bytes));
+    out.resize(static_cast<size_t>(file.gcount()));
+    return true;
+}
+
+bool AsyncFileIO::copy_file_sync(const std::string& source, const std::string& destination) {
+    const std::string temp_path = temp_path_for(destination);
+    fs::path final_file(reinterpret_cast<const char8_t*>(destination.c_str()));
+    fs::path temp_file(reinterpret_cast<const char8_t*>(temp_path.c_str()));
+
+#ifdef __linux__
+    int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        ::close(in);
+        return false;
+    }
+    int out = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+
+    // Share the extents when the filesystem supports reflinks (btrfs, XFS),
+    // otherwise let the kernel copy (server-side on NFS 4.2)
+    bool ok = ioctl(out, FICLONE, in) == 0;
+    if (!ok) {
+        off_t remaining = st.st_size;
+        ok = true;
+        while (remaining > 0) {
+            ssize_t copied = copy_file_range(in, nullptr, out, nullptr, static_cast<size_t>(remaining), 0);
+            if (copied < 0 && errno == EINTR) continue;
+            if (copied <= 0) {
+                ok = false;
+                break;
+            }
+            remaining -= copied;
+        }
+        if (!ok && remaining == st.st_size) {
+            // copy_file_range unsupported here (e.g. cross-device on old kernels)
+            ::close(in);
+            ::close(out);
+            ::unlink(temp_path.c_str());
+            std::vector<uint8_t> data;
+            return read_file_sync(source, data) && write_file_sync(destination, data.data(), data.size());
+        }
+    }
+    ::close(in);
+    if (::close(out) != 0) ok = false;
+    if (!ok) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+#else
+    fs::path source_file(reinterpret_cast<const char8_t*>(source.c_str()));
+    std::error_code copy_ec;
+    if (!fs::copy_file(source_file, temp_file, fs::copy_options::overwrite_existing, copy_ec)) {
+        fs::remove(temp_file, copy_ec);
+        return false;
+    }
+#endif
+
+    std::error_code ec;
+    fs::rename(temp_file, final_file, ec);
+    if (ec) {
+        fs::remove(temp_file, ec);
+        return false;
+    }
+    return true;
+}
+
+void AsyncFileIO::prefetch(const std::string& path) {
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+void AsyncFileIO::drop_cached_pages(const std::string& path) {
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    // Dirty pages cannot be dropped, so write them back first
+    (void)sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+std::string AsyncFileIO::temp_path_for(const std::string& path) {
+    return path + ".fbiu-part";
+}
+
+bool AsyncFileIO::write_file_sync(const std::string& path, const uint8_t* data, size_t size) {
+    const std::string temp_path = temp_path_for(path);
+    fs::path final_file(reinterpret_cast<const char8_t*>(path.c_str()));
+    fs::path temp_file(reinterpret_cast<const char8_t*>(temp_path.c_str()));
+
+#ifdef _WIN32
+    {
+        std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!file) {
+            file.close();
+            std::error_code ec;
+            fs::remove(temp_file, ec);
+            return false;
+        }
+    }
+#else
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+#ifdef __linux__
+    // Preallocate so the single write below does not grow the file block by block.
+    // Not every filesystem supports it; failure is harmless.
+    if (size > 0) (void)fallocate(fd, 0, 0, static_cast<off_t>(size));
+#endif
+    size_t written = 0;
+    while (written < size) {
+        ssize_t ret = ::write(fd, data + written, size - written);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break;
+        written += static_cast<size_t>(ret);
+    }
+    if (::close(fd) != 0 || written != size) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+#endif
+
+    std::error_code ec;
+    fs::rename(temp_file, final_file, ec);
+    if (ec) {
+        fs::remove(temp_file, ec);
+        return false;
+    }
+    return true;
+}
+
+#ifdef FBIU_HAVE_IO_URING
+
+// Minimal io_uring wrapper built on the raw syscalls (no liburing dependency).
+// Only one operation per request is outstanding at a time, and the number of
+// requests is capped at the ring size, so the SQ can never overflow.
+class IoUring {
+public:
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return false;
+
+        sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) sq_len = cq_len = std::max(sq_len, cq_len);
+
+        sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) { sq_ptr = nullptr; return false; }
+        if (single_mmap) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) { cq_ptr = nullptr; return false; }
+        }
+        sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes_ptr = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes_ptr == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+        auto* sq = static_cast<uint8_t*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<uint8_t*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        has_fallocate = supports(IORING_OP_FALLOCATE);
+        has_renameat = supports(IORING_OP_RENAMEAT);
+        has_sync_file_range = supports(IORING_OP_SYNC_FILE_RANGE);
+        has_fadvise = supports(IORING_OP_FADVISE);
+        return supports(IORING_OP_OPENAT) && supports(IORING_OP_READ) &&
+               supports(IORING_OP_WRITE) && supports(IORING_OP_CLOSE);
+    }
+
+    // Optional opcodes; the corresponding step is done synchronously without them
+    bool has_fallocate = false;
+    bool has_renameat = false;
+    bool has_sync_file_range = false;
+    bool has_fadvise = false;
+
+    ~IoUring() {
+        if (sqes) munmap(sqes, sqes_len);
+        if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+        if (sq_ptr) munmap(sq_ptr, sq_len);
+        if (fd >= 0) close(fd);
+    }
+
+    // Fill and submit one SQE. Thread-safe.
+    template <typename Fill>
+    bool submit(Fill&& fill) {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        fill(sqe);
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        while (true) {
+            int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0));
+            if (ret >= 0) return true;
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+        }
+    }
+
+    // Block until a completion is available and pop it
+    bool wait_cqe(io_uring_cqe& out) {
+        while (true) {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            if (head != tail) {
+                out = cqes[head & cq_mask];
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (ret < 0 && errno != EINTR && errno != EAGAIN) return false;
+        }
+    }
+
+private:
+    bool supports(int opcode) {
+        const size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<uint8_t> storage(probe_size, 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        if (opcode > probe->last_op) return false;
+        return (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+    int fd = -1;
+    void* sq_ptr = nullptr;
+    void* cq_ptr = nullptr;
+    size_t sq_len = 0;
+    size_t cq_len = 0;
+    size_t sqes_len = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    std::mutex submit_mutex;
+};
+
+// One whole-file request walking through
+//   read:  OPEN -> READ* -> [EVICT] -> CLOSE
+//   write: OPEN(temp) -> PREALLOCATE -> WRITE* -> [SYNC -> EVICT] -> CLOSE -> RENAME(temp, path)
+// (the bracketed stages only with drop_cache)
+struct UringRequest {
+    enum class Kind { READ, WRITE };
+    enum class Stage { OPEN, PREALLOCATE, TRANSFER, SYNC, EVICT, CLOSE, RENAME };
+
+    Kind kind = Kind::READ;
+    Stage stage = Stage::OPEN;
+    std::string path;       // File opened by the request (temp file for writes)
+    std::string final_path; // Rename target for writes
+    int fd = -1;
+    std::vector<uint8_t> data;
+    size_t offset = 0;
+    bool ok = true;
+    bool drop_cache = false;
+    AsyncFileIO::ReadCallback on_read;
+    AsyncFileIO::WriteCallback on_write;
+};
+
+// Largest single read/write submitted (the SQE length field is 32-bit)
+constexpr size_t MAX_URING_TRANSFER = size_t(1) << 30;
+
+#endif // FBIU_HAVE_IO_URING
+
+struct AsyncFileIO::Impl {
+    unsigned capacity;           // Size of the ring (or fallback queue)
+    std::atomic<unsigned> depth; // Current in-flight limit, <= capacity
+    std::mutex slot_mutex;
+    std::condition_variable slot_condition;
+    unsigned in_flight = 0;
+    std::atomic<uint64_t> slot_wait_ns{0};
+
+#ifdef FBIU_HAVE_IO_URING
+    std::unique_ptr<IoUring> ring;
+    std::thread completion_thread;
+#endif
+    std::unique_ptr<ThreadPool> fallback_pool;
+
+    explicit Impl(unsigned queue_depth) : capacity(std::max(1u, queue_depth)), depth(capacity) {
+#ifdef FBIU_HAVE_IO_URING
+        ring = std::make_unique<IoUring>();
+        if (ring->init(capacity)) {
+            completion_thread = std::thread(&Impl::completion_loop, this);
+            return;
+        }
+        ring.reset();
+#endif
+        fallback_pool = std::make_unique<ThreadPool>(std::min<unsigned>(capacity, 16));
+    }
+
+    ~Impl() {
+        wait();
+#ifdef FBIU_HAVE_IO_URING
+        if (ring) {
+            // user_data 0 tells the completion thread to exit
+            ring->submit([](io_uring_sqe* sqe) {
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = 0;
+            });
+            completion_thread.join();
+        }
+#endif
+    }
+
+    void acquire_slot() {
+        std::unique_lock<std::mutex> lock(slot_mutex);
+        if (in_flight >= depth) {
+            const auto start = std::chrono::steady_clock::now();
+            slot_condition.wait(lock, [this] { return in_flight < depth; });
+            const auto waited = std::chrono::steady_clock::now() - start;
+            slot_wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+        }
+        ++in_flight;
+    }
+
+    void release_slot() {
+        {
+            std::lock_guard<std::mutex> lock(slot_mutex);
+            --in_flight;
+        }
+        slot_condition.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(slot_mutex);
+        slot_condition.wait(lock, [this] { return in_flight == 0; });
+    }
+
+#ifdef FBIU_HAVE_IO_URING
+    void submit_stage(UringRequest* req) {
+        bool submitted = ring->submit([req](io_uring_sqe* sqe) {
+            sqe->user_data = reinterpret_cast<uint64_t>(req);
+            switch (req->stage) {
+                case UringRequest::Stage::OPEN:
+                    sqe->opcode = IORING_OP_OPENAT;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(req->path.c_str());
+                    if (req->kind == UringRequest::Kind::READ) {
+                        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+                    } else {
+                        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+                        sqe->len = 0644;
+                    }
+                    break;
+                case UringRequest::Stage::PREALLOCATE:
+                    sqe->opcode = IORING_OP_FALLOCATE;
+                    sqe->fd = req->fd;
+                    sqe->off = 0;
+                    sqe->addr = req->data.size();  // length
+                    sqe->len = 0;                  // mode
+                    break;
+                case UringRequest::Stage::TRANSFER: {
+                    size_t remaining = req->data.size() - req->offset;
+                    sqe->opcode = req->kind == UringRequest::Kind::READ ? IORING_OP_READ : IORING_OP_WRITE;
+                    sqe->fd = req->fd;
+                    sqe->addr = reinterpret_cast<uint64_t>(req->data.data() + req->offset);
+                    sqe->len = static_cast<uint32_t>(std::min(remaining, MAX_URING_TRANSFER));
+                    sqe->off = req->offset;
+                    break;
+                }
+                case UringRequest::Stage::SYNC:
+                    sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+                    sqe->fd = req->fd;
+                    sqe->off = 0;
+                    sqe->len = 0;  // Up to the end of the file
+                    sqe->sync_range_flags =
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+                    break;
+                case UringRequest::Stage::EVICT:
+                    sqe->opcode = IORING_OP_FADVISE;
+                    sqe->fd = req->fd;
+                    sqe->off = 0;
+                    sqe->len = 0;
+                    sqe->fadvise_advice = POSIX_FADV_DONTNEED;
+                    break;
+                case UringRequest::Stage::CLOSE:
+                    sqe->opcode = IORING_OP_CLOSE;
+                    sqe->fd = req->fd;
+                    break;
+                case UringRequest::Stage::RENAME:
+                    sqe->opcode = IORING_OP_RENAMEAT;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(req->path.c_str());
+                    sqe->len = static_cast<uint32_t>(AT_FDCWD);
+                    sqe->addr2 = reinterpret_cast<uint64_t>(req->final_path.c_str());
+                    break;
+            }
+        });
+        if (!submitted) {
+            req->ok = false;
+            finish(req);
+        }
+    }
+
+    // Advance the request after its current operation completed with `res`
+    void advance(UringRequest* req, int res) {
+        using Stage = UringRequest::Stage;
+        const bool is_write = req->kind == UringRequest::Kind::WRITE;
+        switch (req->stage) {
+            case Stage::OPEN:
+                if (res < 0) {
+                    req->ok = false;
+                    finish(req);
+                    return;
+                }
+                req->fd = res;
+                if (!is_write) {
+                    struct stat st;
+                    if (fstat(req->fd, &st) != 0) {
+                        req->ok = false;
+                        req->stage = Stage::CLOSE;
+                        break;
+                    }
+                    req->data.resize(static_cast<size_t>(st.st_size));
+                }
+                if (req->data.empty()) {
+                    req->stage = Stage::CLOSE;
+                } else if (is_write) {
+                    if (ring->has_fallocate) {
+                        req->stage = Stage::PREALLOCATE;
+                    } else {
+                        (void)fallocate(req->fd, 0, 0, static_cast<off_t>(req->data.size()));
+                        req->stage = Stage::TRANSFER;
+                    }
+                } else {
+                    req->stage = Stage::TRANSFER;
+                }
+                break;
+            case Stage::PREALLOCATE:
+                // Unsupported by some filesystems; the write works regardless
+                req->stage = Stage::TRANSFER;
+                break;
+            case Stage::TRANSFER:
+                if (res < 0) {
+                    req->ok = false;
+                    req->stage = Stage::CLOSE;
+                } else if (res == 0) {
+                    // Short file (truncated while reading) or a stalled write
+                    if (!is_write) req->data.resize(req->offset);
+                    else req->ok = false;
+                    req->stage = Stage::CLOSE;
+                } else {
+                    req->offset += static_cast<size_t>(res);
+                    if (req->offset >= req->data.size()) {
+                        if (!req->drop_cache) req->stage = Stage::CLOSE;
+                        else if (is_write && ring->has_sync_file_range) req->stage = Stage::SYNC;
+                        else req->stage = evict_stage(req);
+                    }
+                }
+                break;
+            case Stage::SYNC:
+                // Best effort: a failed write-back only leaves the pages cached
+                req->stage = evict_stage(req);
+                break;
+            case Stage::EVICT:
+                req->stage = Stage::CLOSE;
+                break;
+            case Stage::CLOSE:
+                if (res < 0) req->ok = false;
+                if (!is_write || !req->ok) {
+                    finish(req);
+                    return;
+                }
+                if (!ring->has_renameat) {
+                    req->ok = ::rename(req->path.c_str(), req->final_path.c_str()) == 0;
+                    finish(req);
+                    return;
+                }
+                req->stage = Stage::RENAME;
+                break;
+            case Stage::RENAME:
+                if (res < 0) req->ok = false;
+                finish(req);
+                return;
+        }
+        submit_stage(req);
+    }
+
+    // EVICT through the ring, or a direct fadvise (cheap) when the kernel
+    // lacks the opcode
+    UringRequest::Stage evict_stage(UringRequest* req) {
+        if (ring->has_fadvise) return UringRequest::Stage::EVICT;
+        (void)posix_fadvise(req->fd, 0, 0, POSIX_FADV_DONTNEED);
+        return UringRequest::Stage::CLOSE;
+    }
+
+    void finish(UringRequest* req) {
+        if (req->kind == UringRequest::Kind::READ) {
+            if (!req->ok) req->data.clear();
+            if (req->on_read) req->on_read(std::move(req->data), req->ok);
+        } else {
+            if (!req->ok) ::unlink(req->path.c_str());
+            if (req->on_write) req->on_write(req->ok, std::move(req->data));
+        }
+        delete req;
+        release_slot();
+    }
+
+    void completion_loop() {
+        io_uring_cqe cqe;
+        while (ring->wait_cqe(cqe)) {
+            if (cqe.user_data == 0) return;
+            advance(reinterpret_cast<UringRequest*>(cqe.user_data), cqe.res);
+        }
+    }
+#endif
+};
+
+AsyncFileIO::AsyncFileIO(unsigned queue_depth) : impl(std::make_unique<Impl>(queue_depth)) {}
+
+AsyncFileIO::~AsyncFileIO() = default;
+
+bool AsyncFileIO::uses_io_uring() const {
+#ifdef FBIU_HAVE_IO_URING
+    return impl->ring != nullptr;
+#else
+    return false;
+#endif
+}
+
+void AsyncFileIO::set_queue_depth(unsigned depth) {
+    {
+        std::lock_guard<std::mutex> lock(impl->slot_mutex);
+        impl->depth = std::clamp(depth, 1u, impl->capacity);
+    }
+    impl->slot_condition.notify_all();
+}
+
+unsigned AsyncFileIO::queue_depth() const {
+    return impl->depth;
+}
+
+unsigned AsyncFileIO::max_queue_depth() const {
+    return impl->capacity;
+}
+
+uint64_t AsyncFileIO::total_slot_wait_ns() const {
+    return impl->slot_wait_ns;
+}
+
+void AsyncFileIO::read_file(const std::string& path, ReadCallback done, bool drop_cache) {
+    impl->acquire_slot();
+#ifdef FBIU_HAVE_IO_URING
+    if (impl->ring) {
+        auto* req = new UringRequest;
+        req->kind = UringRequest::Kind::READ;
+        req->path = path;
+        req->drop_cache = drop_cache;
+        req->on_read = std::move(done);
+        impl->submit_stage(req);
+        return;
+    }
+#endif
+    impl->fallback_pool->enqueue([this, path, drop_cache, done = std::move(done)]() {
+        std::vector<uint8_t> data;
+        bool ok = read_file_sync(path, data);
+        if (!ok) data.clear();
+        if (ok && drop_cache) drop_cached_pages(path);
+        if (done) done(std::move(data), ok);
+        impl->release_slot();
+    });
+}
+
+void AsyncFileIO::write_file(const std::string& path, std::vector<uint8_t> data, WriteCallback done,
+                             bool drop_cache) {
+    impl->acquire_slot();
+#ifdef FBIU_HAVE_IO_URING
+    if (impl->ring) {
+        auto* req = new UringRequest;
+        req->kind = UringRequest::Kind::WRITE;
+        req->path = temp_path_for(path);
+        req->final_path = path;
+        req->drop_cache = drop_cache;
+        req->data = std::move(data);
+        req->on_write = std::move(done);
+        impl->submit_stage(req);
+        return;
+    }
+#endif
+    impl->fallback_pool->enqueue([this, path, drop_cache, data = std::move(data), done = std::move(done)]() mutable {
+        bool ok = write_file_sync(path, data.data(), data.size());
+        if (ok && drop_cache) drop_cached_pages(path);
+        if (done) done(ok, std::move(data));
+        impl->release_slot();
+    });
+}
+
+void AsyncFileIO::wait() {
+    impl->wait();
+}
+
+std::vector<uint8_t> BufferPool::acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare.empty()) return {};
+    std::vector<uint8_t> buffer = std::move(spare.back());
+    spare.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(std::vector<uint8_t>&& buffer) {
+    buffer.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare.size() < max_spare) spare.push_back(std::move(buffer));
+}
+
+} // namespace fbiu
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace fbiu {
+
+// Default number of whole-file requests kept in flight by AsyncFileIO
+constexpr unsigned DEFAULT_IO_QUEUE_DEPTH = 128;
+
+// Asynchronous whole-file reader/writer used by the batch pipeline.
+//
+// On Linux the open/read/write/close sequence of every request is submitted
+// through io_uring, so a single completion thread can keep hundreds of file
+// operations in flight without blocking the CPU workers. When io_uring is not
+// available (other platforms, old kernels, seccomp) a small pool of blocking
+// I/O threads is used instead.
+//
+// Writes are atomic: the data goes to "<path>.fbiu-part" with one write
+// (after preallocating the file) and is renamed over <path> on success, so a
+// killed batch never leaves a half-written output under its final name.
+//
+// Callbacks run on the I/O thread and must stay short (typically: hand the
+// buffer to a ThreadPool). They must not submit new requests themselves.
+class AsyncFileIO {
+public:
+    using ReadCallback = std::function<void(std::vector<uint8_t>&& data, bool ok)>;
+    // Receives the written buffer back so it can be recycled (see BufferPool)
+    using WriteCallback = std::function<void(bool ok, std::vector<uint8_t>&& data)>;
+
+    explicit AsyncFileIO(unsigned queue_depth = DEFAULT_IO_QUEUE_DEPTH);
+    ~AsyncFileIO();
+
+    AsyncFileIO(const AsyncFileIO&) = delete;
+    AsyncFileIO& operator=(const AsyncFileIO&) = delete;
+
+    // Queue a read of the whole file. Blocks while queue_depth requests are in flight.
+    // With drop_cache the file's pages are evicted from the page cache once read.
+    void read_file(const std::string& path, ReadCallback done, bool drop_cache = false);
+
+    // Queue an atomic write of the whole buffer (temp file + rename). With
+    // drop_cache the data is written back and evicted before the callback runs.
+    void write_file(const std::string& path, std::vector<uint8_t> data, WriteCallback done,
+                    bool drop_cache = false);
+
+    // Wait until every submitted request has completed and its callback returned
+    void wait();
+
+    // True when requests go through io_uring rather than the thread fallback
+    bool uses_io_uring() const;
+
+    // Keep at most `depth` requests in flight (clamped to 1..max_queue_depth(),
+    // the depth given to the constructor). Takes effect for new requests.
+    void set_queue_depth(unsigned depth);
+    unsigned queue_depth() const;
+    unsigned max_queue_depth() const;
+
+    // Total time callers of read_file/write_file have spent blocked waiting
+    // for a free slot (for the adaptive controller, see BatchEngine)
+    uint64_t total_slot_wait_ns() const;
+
+    // Blocking helpers (also used by the thread fallback)
+    static bool read_file_sync(const std::string& path, std::vector<uint8_t>& out);
+    static bool write_file_sync(const std::string& path, const uint8_t* data, size_t size);
+
+    // Read at most `max_bytes` from the start of the file
+    static bool read_file_prefix_sync(const std::string& path, size_t max_bytes, std::vector<uint8_t>& out);
+
+    // Copy a file byte for byte (atomically, like writes). Uses a reflink
+    // (FICLONE) or copy_file_range on Linux so the data never enters user space.
+    static bool copy_file_sync(const std::string& source, const std::string& destination);
+
+    // Page cache hints (no-ops where unsupported). prefetch() starts reading
+    // the file in the background; drop_cached_pages() writes back its dirty
+    // pages and evicts it, so a large batch does not push other processes'
+    // data out of the cache.
+    static void prefetch(const std::string& path);
+    static void drop_cached_pages(const std::string& path);
+
+    // Name of the temporary file a write to `path` goes through
+    static std::string temp_path_for(const std::string& path);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Free list of byte buffers, so encoders write into memory whose capacity
+// was already grown by a previous image instead of reallocating per file.
+class BufferPool {
+public:
+    explicit BufferPool(size_t max_spare = 64) : max_spare(max_spare) {}
+
+    std::vector<uint8_t> acquire();
+    void release(std::vector<uint8_t>&& buffer);
+
+private:
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> spare;
+    size_t max_spare;
+};
+
+} // namespace fbiu
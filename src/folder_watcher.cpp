@@ -0,0 +1,128 @@
+#include "folder_watcher.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fbiu {
+
+FolderWatcher::FolderWatcher(int settle_ms) : settle_ms(std::max(0, settle_ms)) {}
+
+FolderWatcher::~FolderWatcher() {
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#endif
+}
+
+bool FolderWatcher::is_supported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FolderWatcher::open(const std::string& dir) {
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return false;
+    const uint32_t mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+                          IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR;
+    if (inotify_add_watch(fd, dir.c_str(), mask) < 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+#else
+    (void)dir;
+    return false;
+#endif
+}
+
+void FolderWatcher::handle_events() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16384];
+    while (true) {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        if (len <= 0) return;  // EAGAIN: drained
+
+        for (char* ptr = buffer; ptr < buffer + len; ) {
+            const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+            if (event->len == 0 || (event->mask & IN_ISDIR)) continue;
+
+            std::string name(event->name);
+            if (event->mask & (IN_CREATE | IN_MODIFY)) {
+                // Still being written: restart the wait
+                settling.erase(name);
+            }
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                settling[name] = Clock::now() + std::chrono::milliseconds(settle_ms);
+            }
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                settling.erase(name);
+                changed_in_flight.erase(name);
+            }
+        }
+    }
+#endif
+}
+
+void FolderWatcher::done(const std::string& name) {
+    std::lock_guard<std::mutex> lock(finished_mutex);
+    finished.push_back(name);
+}
+
+std::vector<std::string> FolderWatcher::poll(int timeout_ms) {
+    std::vector<std::string> ready;
+#ifdef __linux__
+    if (fd < 0) return ready;
+
+    // Files that changed while their job ran are due again now
+    std::vector<std::string> done_names;
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        done_names.swap(finished);
+    }
+    for (const std::string& name : done_names) {
+        in_flight.erase(name);
+        if (changed_in_flight.erase(name)) settling.emplace(name, Clock::now());
+    }
+
+    // Do not sleep past the moment the next settling file becomes ready
+    auto now = Clock::now();
+    for (const auto& [name, ready_at] : settling) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(ready_at - now).count();
+        timeout_ms = static_cast<int>(std::clamp<long long>(wait, 0, timeout_ms));
+    }
+
+    pollfd pfd{fd, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN)) {
+        handle_events();
+    }
+
+    now = Clock::now();
+    for (auto it = settling.begin(); it != settling.end(); ) {
+        if (it->second <= now) {
+            if (in_flight.insert(it->first).second) {
+                ready.push_back(it->first);
+            } else {
+                changed_in_flight.insert(it->first);
+            }
+            it = settling.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#else
+    (void)timeout_ms;
+#endif
+    return ready;
+}
+
+} // namespace fbiu
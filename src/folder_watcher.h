@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <chrono>
+
+namespace fbiu {
+
+// Event-driven directory watcher (inotify on Linux).
+//
+// A file is reported once its writer has finished with it: either it was
+// closed after writing (IN_CLOSE_WRITE) or renamed into the directory
+// (IN_MOVED_TO), and no further modification arrived for `settle_ms`.
+// The directory is never rescanned; only kernel events are consumed.
+//
+// A reported file stays in flight until done() is called for it. If it is
+// written again in the meantime it is reported once more after done(), so
+// two jobs never work on the same file at once.
+class FolderWatcher {
+public:
+    explicit FolderWatcher(int settle_ms = 500);
+    ~FolderWatcher();
+
+    FolderWatcher(const FolderWatcher&) = delete;
+    FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+    // Start watching `dir` (UTF-8). Returns false if unsupported or on error.
+    bool open(const std::string& dir);
+
+    // Wait up to timeout_ms for events and return the names (not paths) of
+    // files whose writes have settled since the previous call and that are
+    // not in flight. Every returned name must later be passed to done().
+    std::vector<std::string> poll(int timeout_ms);
+
+    // The job for `name` has finished. May be called from any thread.
+    void done(const std::string& name);
+
+    static bool is_supported();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void handle_events();
+
+    int fd = -1;
+    int settle_ms;
+    std::map<std::string, Clock::time_point> settling; // Closed, waiting for the quiet period
+    std::set<std::string> in_flight;                // Reported, job not done yet
+    std::set<std::string> changed_in_flight;        // Settled again while in flight
+
+    std::mutex finished_mutex;
+    std::vector<std::string> finished;              // Passed to done(), not yet applied by poll()
+};
+
+} // namespace fbiu
@@ -0,0 +1,205 @@
+#include "frame_stream.h"
+#include "qoi_codec.h"
+#include "raw_format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace fbiu {
+
+namespace {
+
+// Frames grow by at most this much per read, so a size field larger than
+// what the stream holds fails at its end without allocating the whole size
+constexpr size_t READ_STEP = size_t(1) << 20;
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint32_t read_le32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+} // namespace
+
+bool parse_stream_framing(const std::string& name, StreamFraming& out) {
+    if (name == "concat") {
+        out = StreamFraming::CONCATENATED;
+    } else if (name == "length") {
+        out = StreamFraming::LENGTH_PREFIXED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool FrameReader::read(std::vector<uint8_t>& frame, uint64_t count) {
+    if (count > MAX_FRAME_BYTES - frame.size()) return fail("frame too large");
+    while (count > 0) {
+        const size_t step = static_cast<size_t>(std::min<uint64_t>(count, READ_STEP));
+        const size_t offset = frame.size();
+        try {
+            frame.resize(offset + step);
+        } catch (const std::bad_alloc&) {
+            return fail("out of memory");
+        }
+        if (std::fread(frame.data() + offset, 1, step, in) != step) return false;
+        count -= step;
+    }
+    return true;
+}
+
+int FrameReader::get(std::vector<uint8_t>& frame) {
+    int c = std::getc(in);
+    if (c != EOF) frame.push_back(static_cast<uint8_t>(c));
+    return c == EOF ? -1 : c;
+}
+
+bool FrameReader::fail(const char* message) {
+    // read() reports size and memory errors before its caller's "truncated"
+    if (error_message.empty()) error_message = message;
+    return false;
+}
+
+bool FrameReader::next(std::vector<uint8_t>& frame) {
+    frame.clear();
+
+    // A clean end of stream is only allowed between frames
+    int first = get(frame);
+    if (first < 0) return false;
+
+    if (framing == StreamFraming::LENGTH_PREFIXED) {
+        if (!read(frame, 3)) return fail("truncated length prefix");
+        const uint32_t size = read_be32(frame.data());
+        frame.clear();
+        if (!read(frame, size)) return fail("truncated frame");
+        return true;
+    }
+
+    if (get(frame) < 0) return fail("truncated frame");
+    switch (frame[0]) {
+        case 0x89: return read_png(frame);
+        case 0xFF: return read_jpeg(frame);
+        case 'B': return read_bmp(frame);
+        case 'q': return read_qoi(frame);
+        case 'F': return read_raw(frame);
+        default: return fail("unrecognised image in concatenated stream (use length framing)");
+    }
+}
+
+bool FrameReader::read_png(std::vector<uint8_t>& frame) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (!read(frame, 6) || std::memcmp(frame.data(), signature, 8) != 0) return fail("invalid PNG signature");
+
+    // Chunks up to and including IEND
+    while (true) {
+        const size_t chunk = frame.size();
+        if (!read(frame, 8)) return fail("truncated PNG");
+        const uint32_t length = read_be32(frame.data() + chunk);
+        if (length > 0x7FFFFFFFu) return fail("invalid PNG chunk length");
+        const bool end = std::memcmp(frame.data() + chunk + 4, "IEND", 4) == 0;
+        if (!read(frame, uint64_t(length) + 4)) return fail("truncated PNG");
+        if (end) return true;
+    }
+}
+
+bool FrameReader::read_jpeg(std::vector<uint8_t>& frame) {
+    if (frame[1] != 0xD8) return fail("invalid JPEG signature");
+
+    // Marker segments carry their length; the entropy-coded data after SOS
+    // runs until the next marker that is neither a stuffed 0xFF00 nor a
+    // restart marker. Reading stops at EOI.
+    int marker = -1;
+    while (true) {
+        if (marker < 0) {
+            if (get(frame) != 0xFF) return fail("invalid JPEG marker");
+            do {
+                marker = get(frame);
+            } while (marker == 0xFF);
+            if (marker < 0) return fail("truncated JPEG");
+        }
+        const int current = marker;
+        marker = -1;
+        if (current == 0xD9) return true;
+        if ((current >= 0xD0 && current <= 0xD7) || current == 0x01) continue;
+
+        const size_t segment = frame.size();
+        if (!read(frame, 2)) return fail("truncated JPEG");
+        const size_t length = (size_t(frame[segment]) << 8) | frame[segment + 1];
+        if (length < 2) return fail("invalid JPEG segment length");
+        if (!read(frame, length - 2)) return fail("truncated JPEG");
+        if (current != 0xDA) continue;
+
+        while (marker < 0) {
+            int c = get(frame);
+            if (c < 0) return fail("truncated JPEG");
+            if (c != 0xFF) continue;
+            int next;
+            do {
+                next = get(frame);
+            } while (next == 0xFF);
+            if (next < 0) return fail("truncated JPEG");
+            if (next != 0x00 && (next < 0xD0 || next > 0xD7)) marker = next;
+        }
+    }
+}
+
+bool FrameReader::read_bmp(std::vector<uint8_t>& frame) {
+    if (frame[1] != 'M' || !read(frame, 4)) return fail("invalid BMP header");
+    const uint32_t size = read_le32(frame.data() + 2);
+    if (size < 26) return fail("invalid BMP file size");
+    if (!read(frame, size - 6)) return fail("truncated BMP");
+    return true;
+}
+
+bool FrameReader::read_qoi(std::vector<uint8_t>& frame) {
+    if (!read(frame, 12) || std::memcmp(frame.data(), "qoif", 4) != 0) return fail("invalid QOI header");
+    const uint64_t pixels = uint64_t(read_be32(frame.data() + 4)) * read_be32(frame.data() + 8);
+    if (pixels > QOI_MAX_PIXELS) return fail("invalid QOI header");
+
+    // Walk the chunks counting pixels (no colours are decoded), then the
+    // 8-byte end marker
+    uint64_t count = 0;
+    while (count < pixels) {
+        int op = get(frame);
+        if (op < 0) return fail("truncated QOI");
+        if (op == 0xFE || op == 0xFF) {
+            if (!read(frame, op == 0xFE ? 3 : 4)) return fail("truncated QOI");
+            ++count;
+        } else if ((op >> 6) == 3) {
+            count += (op & 0x3F) + 1;
+        } else {
+            if ((op >> 6) == 2 && get(frame) < 0) return fail("truncated QOI");
+            ++count;
+        }
+    }
+    if (!read(frame, 8)) return fail("truncated QOI");
+    return true;
+}
+
+bool FrameReader::read_raw(std::vector<uint8_t>& frame) {
+    if (!read(frame, 30) || std::memcmp(frame.data(), "FBRAW", 5) != 0) return fail("invalid .fbraw header");
+    const uint32_t height = read_le32(frame.data() + 12);
+    const uint32_t stride = read_le32(frame.data() + 20);
+    const uint64_t data_offset = uint64_t(read_le32(frame.data() + 24)) | (uint64_t(read_le32(frame.data() + 28)) << 32);
+    if (data_offset < 32 || data_offset > (uint64_t(1) << 20) || height > RAW_MAX_DIMENSION) {
+        return fail("invalid .fbraw header");
+    }
+    // At most 2^20 + 2^32 * 2^24: no overflow, and read() enforces MAX_FRAME_BYTES
+    if (!read(frame, (data_offset - 32) + uint64_t(stride) * height)) return fail("truncated .fbraw");
+    return true;
+}
+
+bool write_frame(std::FILE* out, StreamFraming framing, const uint8_t* data, size_t size) {
+    if (framing == StreamFraming::LENGTH_PREFIXED) {
+        const uint32_t length = static_cast<uint32_t>(size);
+        const uint8_t prefix[4] = {uint8_t(length >> 24), uint8_t(length >> 16), uint8_t(length >> 8), uint8_t(length)};
+        if (std::fwrite(prefix, 1, 4, out) != 4) return false;
+    }
+    if (size > 0 && std::fwrite(data, 1, size, out) != size) return false;
+    return std::fflush(out) == 0;
+}
+
+} // namespace fbiu
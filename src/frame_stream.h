@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace fbiu {
+
+// How images follow each other in a byte stream (stdin/stdout pipelines)
+enum class StreamFraming {
+    CONCATENATED,     // Back to back; the length comes from each image's own
+                      // structure (PNG, JPEG, BMP, QOI, .fbraw)
+    LENGTH_PREFIXED   // Each image preceded by its size as a 4-byte big-endian
+                      // integer (any input format; size 0 = failed frame)
+};
+
+// Largest encoded frame a FrameReader accepts, the fast PNG decoder's limit
+// on decoded pixel bytes; a corrupt size field fails the frame instead of
+// allocating it
+constexpr uint64_t MAX_FRAME_BYTES = uint64_t(1) << 32;
+
+// Parse "concat" / "length"
+bool parse_stream_framing(const std::string& name, StreamFraming& out);
+
+// Splits a stream into encoded images without decoding them
+class FrameReader {
+public:
+    FrameReader(std::FILE* in, StreamFraming framing) : in(in), framing(framing) {}
+
+    // Read the next image into `frame` (replacing its contents). Returns
+    // false at the end of the stream, or on a truncated or unrecognised
+    // frame, in which case error() is set.
+    bool next(std::vector<uint8_t>& frame);
+
+    const std::string& error() const { return error_message; }
+
+private:
+    bool read(std::vector<uint8_t>& frame, uint64_t count);  // Append `count` bytes
+    int get(std::vector<uint8_t>& frame);                    // Append one byte (-1 at EOF)
+    bool fail(const char* message);                          // Keeps the first message
+
+    bool read_png(std::vector<uint8_t>& frame);
+    bool read_jpeg(std::vector<uint8_t>& frame);
+    bool read_bmp(std::vector<uint8_t>& frame);
+    bool read_qoi(std::vector<uint8_t>& frame);
+    bool read_raw(std::vector<uint8_t>& frame);
+
+    std::FILE* in;
+    StreamFraming framing;
+    std::string error_message;
+};
+
+// Write one image (with its length prefix when framed so) and flush, so the
+// next process in the pipeline sees it right away
+bool write_frame(std::FILE* out, StreamFraming framing, const uint8_t* data, size_t size);
+
+} // namespace fbiu
@@ -0,0 +1,264 @@
+#include "image_data.h"
+
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace fbiu {
+
+namespace {
+
+#ifdef __linux__
+
+// Released huge-page mappings, kept for the next frames of the thread that
+// mapped them. Reusing a mapping skips the munmap/mmap pair and the
+// zero-filled page faults of a fresh one, and its pages stay on the NUMA
+// node of that thread (workers are pinned). A mapping freed on another
+// thread still goes back to its own pool.
+//
+// The pool is bounded so one huge frame does not pin memory in every
+// worker: a mapping is reused only for requests of at least half its size,
+// a pool keeps at most MAX_MAPPINGS and MAX_BYTES, and mappings unused for
+// MAX_IDLE are unmapped at the pool's next use (or by release_cached()).
+struct HugePagePool {
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MAX_MAPPINGS = 3;  // Input, output and a spare per worker
+    static constexpr size_t MAX_BYTES = size_t(128) << 20;
+    static constexpr std::chrono::seconds MAX_IDLE{5};
+
+    struct Mapping {
+        void* memory;
+        size_t length;
+        Clock::time_point released;
+    };
+
+    std::mutex mutex;
+    std::vector<Mapping> free;  // Oldest first
+    size_t free_bytes = 0;
+
+    ~HugePagePool() {
+        for (const Mapping& mapping : free) munmap(mapping.memory, mapping.length);
+    }
+
+    // Smallest kept mapping of `length` to 2 * `length` bytes, or nullptr
+    void* take(size_t length, size_t& mapped_length) {
+        std::vector<Mapping> evicted;
+        void* memory = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            evict_idle(Clock::now(), evicted);
+            auto best = free.end();
+            for (auto it = free.begin(); it != free.end(); ++it) {
+                if (it->length >= length && it->length / 2 <= length &&
+                    (best == free.end() || it->length < best->length)) {
+                    best = it;
+                }
+            }
+            if (best != free.end()) {
+                memory = best->memory;
+                mapped_length = best->length;
+                free_bytes -= best->length;
+                free.erase(best);
+            }
+        }
+        unmap(evicted);
+        return memory;
+    }
+
+    // Keep `memory` for reuse; the oldest mappings are unmapped to stay
+    // within the limits
+    void give(void* memory, size_t length) {
+        if (length > MAX_BYTES) {
+            munmap(memory, length);
+            return;
+        }
+        std::vector<Mapping> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const Clock::time_point now = Clock::now();
+            evict_idle(now, evicted);
+            free.push_back({memory, length, now});
+            free_bytes += length;
+            while (free.size() > MAX_MAPPINGS || free_bytes > MAX_BYTES) {
+                free_bytes -= free.front().length;
+                evicted.push_back(free.front());
+                free.erase(free.begin());
+            }
+        }
+        unmap(evicted);
+    }
+
+    // Unmap every kept mapping
+    void clear() {
+        std::vector<Mapping> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            evicted.swap(free);
+            free_bytes = 0;
+        }
+        unmap(evicted);
+    }
+
+private:
+    // Move mappings released before now - MAX_IDLE to `evicted` (under the lock)
+    void evict_idle(Clock::time_point now, std::vector<Mapping>& evicted) {
+        while (!free.empty() && now - free.front().released > MAX_IDLE) {
+            free_bytes -= free.front().length;
+            evicted.push_back(free.front());
+            free.erase(free.begin());
+        }
+    }
+
+    static void unmap(const std::vector<Mapping>& mappings) {
+        for (const Mapping& mapping : mappings) munmap(mapping.memory, mapping.length);
+    }
+};
+
+// Every thread's pool, for release_cached()
+std::mutex pools_mutex;
+std::vector<std::weak_ptr<HugePagePool>> pools;
+
+// Shared with the deleters of this thread's frames, so it outlives the
+// thread while any of them is alive
+const std::shared_ptr<HugePagePool>& thread_huge_page_pool() {
+    thread_local const std::shared_ptr<HugePagePool> pool = [] {
+        auto created = std::make_shared<HugePagePool>();
+        std::lock_guard<std::mutex> lock(pools_mutex);
+        std::erase_if(pools, [](const std::weak_ptr<HugePagePool>& p) { return p.expired(); });
+        pools.push_back(created);
+        return created;
+    }();
+    return pool;
+}
+
+// Map `size` bytes starting on a huge-page boundary and ask for transparent
+// huge pages (a full-frame pass then touches a few dozen TLB entries instead
+// of thousands). A new mapping's pages land on the NUMA node of the thread
+// that first writes them: the worker decoding into the frame.
+// nullptr on failure.
+void* map_huge(size_t length) {
+    void* base = mmap(nullptr, length + ImageData::HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return nullptr;
+
+    // Keep only the aligned part of the over-sized mapping
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(base) + ImageData::HUGE_PAGE_SIZE - 1) &
+                            ~(ImageData::HUGE_PAGE_SIZE - 1);
+    const size_t head = start - reinterpret_cast<uintptr_t>(base);
+    if (head > 0) munmap(base, head);
+    if (ImageData::HUGE_PAGE_SIZE - head > 0) {
+        munmap(reinterpret_cast<void*>(start + length), ImageData::HUGE_PAGE_SIZE - head);
+    }
+
+    void* memory = reinterpret_cast<void*>(start);
+    madvise(memory, length, MADV_HUGEPAGE);
+    return memory;
+}
+
+// Huge-page backed storage for `size` bytes, reusing this thread's released
+// mappings first. nullptr on failure.
+void* allocate_huge(size_t size, std::shared_ptr<void>& storage) {
+    const size_t length = (size + ImageData::HUGE_PAGE_SIZE - 1) & ~(ImageData::HUGE_PAGE_SIZE - 1);
+    std::shared_ptr<HugePagePool> pool = thread_huge_page_pool();
+    size_t mapped_length = length;
+    void* memory = pool->take(length, mapped_length);
+    if (!memory) memory = map_huge(length);
+    if (!memory) return nullptr;
+    storage = std::shared_ptr<void>(memory, [pool = std::move(pool), mapped_length](void* p) {
+        pool->give(p, mapped_length);
+    });
+    return memory;
+}
+
+#endif
+
+} // namespace
+
+void ImageData::release_cached() {
+#ifdef __linux__
+    std::vector<std::shared_ptr<HugePagePool>> live;
+    {
+        std::lock_guard<std::mutex> lock(pools_mutex);
+        for (const auto& pool : pools) {
+            if (auto locked = pool.lock()) live.push_back(std::move(locked));
+        }
+    }
+    for (const auto& pool : live) pool->clear();
+#endif
+}
+
+ImageData ImageData::allocate(int width, int height, int channels) {
+    ImageData image;
+    if (width <= 0 || height <= 0 || channels <= 0 || channels > 4) return image;
+
+    const size_t row_bytes = static_cast<size_t>(width) * channels;
+    const size_t stride = (row_bytes + ROW_ALIGNMENT - 1) & ~(ROW_ALIGNMENT - 1);
+    if (static_cast<size_t>(height) > std::numeric_limits<size_t>::max() / stride) return image;
+
+    const size_t size = stride * height;
+    void* memory = nullptr;
+#ifdef __linux__
+    if (size >= HUGE_PAGE_THRESHOLD) memory = allocate_huge(size, image.storage);
+#endif
+    if (!memory) {
+        memory = ::operator new(size, std::align_val_t{ROW_ALIGNMENT}, std::nothrow);
+        if (!memory) return image;
+        image.storage = std::shared_ptr<void>(memory, [](void* p) {
+            ::operator delete(p, std::align_val_t{ROW_ALIGNMENT});
+        });
+    }
+
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.stride = stride;
+    image.pixels = static_cast<uint8_t*>(memory);
+    return image;
+}
+
+ImageData ImageData::wrap(uint8_t* data, int width, int height, int channels, size_t stride,
+                          std::shared_ptr<void> owner) {
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.stride = stride;
+    image.pixels = data;
+    image.storage = std::move(owner);
+    if (!image.is_valid()) return ImageData{};
+    return image;
+}
+
+ImageData ImageData::view(int x, int y, int width, int height) const {
+    if (!is_valid() || x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        width > this->width - x || height > this->height - y) {
+        return ImageData{};
+    }
+
+    ImageData sub = *this;
+    sub.width = width;
+    sub.height = height;
+    sub.pixels = pixels + static_cast<size_t>(y) * stride + static_cast<size_t>(x) * channels;
+    return sub;
+}
+
+ImageData ImageData::clone() const {
+    if (!is_valid()) return ImageData{};
+
+    ImageData copy = allocate(width, height, channels);
+    if (!copy.is_valid()) return copy;
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(copy.row(y), row(y), row_bytes());
+    }
+    return copy;
+}
+
+} // namespace fbiu
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace fbiu {
+
+// 8-bit interleaved image (1-4 channels) with an explicit row stride.
+//
+// The pixel storage is shared: copies and views refer to the same memory,
+// so passing an ImageData around never copies pixels, and writes through
+// one copy are visible in the others. clone() makes an independent copy.
+//
+//   allocate()  rows start on ROW_ALIGNMENT-byte boundaries; the memory is
+//               not initialised (kernels overwrite every byte anyway).
+//               On Linux, frames of HUGE_PAGE_THRESHOLD bytes or more get
+//               huge-page aligned MADV_HUGEPAGE mappings from a small,
+//               size-capped pool per thread, so the thread's next frames
+//               of similar size reuse memory that is already faulted in on
+//               its NUMA node; release_cached() empties the pools
+//   wrap()      adopts memory owned elsewhere (stb, mmap, Qt); `owner` is
+//               released with the last reference
+//   view()      a sub-image (tile, strip) sharing the parent's rows
+//
+// width / height / channels / stride describe the current storage; set
+// them only through the functions above.
+struct ImageData {
+    static constexpr size_t ROW_ALIGNMENT = 64;
+    static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+    static constexpr size_t HUGE_PAGE_THRESHOLD = size_t(8) << 20;
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    size_t stride = 0;  // Bytes from the start of one row to the next
+
+    // Empty (invalid) image on bad dimensions or allocation failure
+    static ImageData allocate(int width, int height, int channels);
+    static ImageData wrap(uint8_t* data, int width, int height, int channels, size_t stride,
+                          std::shared_ptr<void> owner);
+
+    // Unmap the frame memory every thread keeps for reuse (when going idle)
+    static void release_cached();
+
+    // Width x height region at (x, y); empty if it is out of range
+    ImageData view(int x, int y, int width, int height) const;
+    ImageData clone() const;
+
+    bool is_valid() const {
+        return width > 0 && height > 0 && channels > 0 && channels <= 4 && pixels && stride >= row_bytes();
+    }
+
+    size_t row_bytes() const { return static_cast<size_t>(width) * channels; }
+    bool is_contiguous() const { return stride == row_bytes(); }
+
+    uint8_t* data() { return pixels; }
+    const uint8_t* data() const { return pixels; }
+    uint8_t* row(int y) { return pixels + static_cast<size_t>(y) * stride; }
+    const uint8_t* row(int y) const { return pixels + static_cast<size_t>(y) * stride; }
+
+private:
+    uint8_t* pixels = nullptr;
+    std::shared_ptr<void> storage;
+};
+
+} // namespace fbiu
@@ -1,5 +1,14 @@
-#include "image_processor.h"
-#include "thread_pool.h"
+﻿#include "image_processor.h"
+#include "batch_engine.h"
+#include "shard.h"
+#include "folder_watcher.h"
+#include "png_decoder.h"
+#include "jpeg_decoder.h"
+#include "qoi_codec.h"
+#include "raw_format.h"
+#include "trace.h"
+#include "progress.h"
+#include "journal.h"
 
 // Suppress MSVC warnings
 #define _CRT_SECURE_NO_WARNINGS
@@ -12,10 +21,18 @@
 #include <filesystem>
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <atomic>
 #include <thread>
-#include <fstream>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <climits>
+#include <memory>
+#include <cstring>
+#include <cmath>
 
 #ifdef ENABLE_SIMD
 #include <immintrin.h>
@@ -26,70 +43,599 @@ namespace fs = std::filesystem;
 namespace fbiu {
 
 ImageData ImageProcessor::load_image(const std::string& path) {
-    ImageData result;
-    
-    // Use char8_t for C++20 compliant UTF-8 path handling
-    fs::path file_path(reinterpret_cast<const char8_t*>(path.c_str()));
-    
-    // Open file using standard stream
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file) {
+    std::vector<uint8_t> buffer;
+    if (!AsyncFileIO::read_file_sync(path, buffer)) {
         std::cerr << "Failed to open file: " << path << std::endl;
-        return result;
+        return ImageData{};
     }
 
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    
-    std::vector<char> buffer(static_cast<size_t>(size));
-    if (!file.read(buffer.data(), size)) return result;
+    ImageData result = decode_image(buffer.data(), buffer.size());
+    if (!result.is_valid()) {
+        std::cerr << "Failed to load image: " << path << std::endl;
+    }
+    return result;
+}
 
-    int w, h, c;
-    unsigned char* data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(buffer.data()), static_cast<int>(size), &w, &h, &c, 0);
-    
-    if (!data) {
+ImageData ImageProcessor::load_image_scaled(const std::string& path, int max_width, int max_height) {
+    std::vector<uint8_t> buffer;
+    if (!AsyncFileIO::read_file_sync(path, buffer)) {
+        std::cerr << "Failed to open file: " << path << std::endl;
+        return ImageData{};
+    }
+
+    ImageData result;
+    if (decode_jpeg_scaled(buffer.data(), buffer.size(), max_width, max_height, result)) return result;
+
+    result = decode_image(buffer.data(), buffer.size());
+    if (!result.is_valid()) {
         std::cerr << "Failed to load image: " << path << std::endl;
+    }
+    return result;
+}
+
+ImageData ImageProcessor::decode_image(const uint8_t* data, size_t size) {
+    ImageData result;
+    if (!data || size == 0 || size > static_cast<size_t>(INT_MAX)) return result;
+
+    // Our own intermediate formats, identified by their magic
+    if (is_qoi(data, size)) {
+        decode_qoi(data, size, result);
         return result;
     }
+    if (is_raw_image(data, size)) {
+        decode_raw(data, size, result);
+        return result;
+    }
+
+    // Common 8-bit PNGs take the fast path; everything else goes to stb
+    if (decode_png_fast(data, size, result)) return result;
+
+    int w, h, c;
+    unsigned char* pixels = stbi_load_from_memory(data, static_cast<int>(size), &w, &h, &c, 0);
+    if (!pixels) return ImageData{};
     
-    result.width = w;
-    result.height = h;
-    result.channels = c;
-    result.pixels.assign(data, data + (w * h * c));
+    // Adopt stb's buffer instead of copying it
+    std::shared_ptr<void> owner(pixels, stbi_image_free);
+    return ImageData::wrap(pixels, w, h, c, static_cast<size_t>(w) * c, std::move(owner));
+}
+
+bool ImageProcessor::save_png(const std::string& path, const ImageData& image) {
+    // Encode into a per-thread buffer that keeps its capacity between calls,
+    // then write the whole file at once (temp file + rename)
+    thread_local std::vector<uint8_t> encoded;
+    if (!encode_png(image, encoded)) return false;
     
-    stbi_image_free(data);
-    return result;
+    return AsyncFileIO::write_file_sync(path, encoded.data(), encoded.size());
 }
 
-// stb_image_write 用のコールバック関数
-static void write_to_stream(void* context, void* data, int size) {
-    std::ofstream* ofs = static_cast<std::ofstream*>(context);
-    ofs->write(static_cast<const char*>(data), size);
+// stb_image_write 用のコールバック関数 (メモリバッファへ追記)
+static void write_to_vector(void* context, void* data, int size) {
+    auto* out = static_cast<std::vector<uint8_t>*>(context);
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    out->insert(out->end(), bytes, bytes + size);
 }
 
-bool ImageProcessor::save_png(const std::string& path, const ImageData& image) {
+// Small open-addressing map of packed RGBA colours, used to collect the
+// colours of an image (up to 256) and to index them when writing a palette
+class ColorTable {
+public:
+    static constexpr int MAX_COLORS = 256;
+
+    // Returns the index of `color`, adding it if there is room; -1 when full
+    int find_or_add(uint32_t color) {
+        if (count > 0 && color == last_color) return last_index;
+        uint32_t slot = (color * 2654435761u) >> (32 - TABLE_BITS);
+        while (used[slot]) {
+            if (keys[slot] == color) {
+                last_color = color;
+                last_index = values[slot];
+                return last_index;
+            }
+            slot = (slot + 1) & (TABLE_SIZE - 1);
+        }
+        if (count == MAX_COLORS) return -1;
+        used[slot] = true;
+        keys[slot] = color;
+        values[slot] = static_cast<uint16_t>(count);
+        colors.push_back(color);
+        last_color = color;
+        last_index = count++;
+        return last_index;
+    }
+
+    std::vector<uint32_t> colors;  // In insertion order (= index order)
+
+private:
+    static constexpr int TABLE_BITS = 10;
+    static constexpr uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+
+    uint32_t keys[TABLE_SIZE];
+    uint16_t values[TABLE_SIZE];
+    bool used[TABLE_SIZE] = {};
+    int count = 0;
+    uint32_t last_color = 0;
+    int last_index = 0;
+};
+
+// Accumulates ImageStats one output pixel at a time inside a kernel loop
+class StatsCollector {
+public:
+    // Pixels must be added in row-major order of a `width`-wide image
+    explicit StatsCollector(int width) : width(width) {}
+
+    void add(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+        grayscale &= (r == g) & (g == b);
+        opaque &= (a == 255);
+        if (palette_open) {
+            const uint32_t color = r | (g << 8) | (b << 16) | (static_cast<uint32_t>(a) << 24);
+            palette_open = table.find_or_add(color) >= 0;
+        }
+        alpha_sum += a;
+        if (a != 0) {
+            ++visible;
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            if (min_y < 0) min_y = y;
+            max_y = y;
+        }
+        if (++x == width) {
+            x = 0;
+            ++y;
+        }
+    }
+
+    void finish(ImageStats& stats) {
+        stats.grayscale = grayscale;
+        stats.opaque = opaque;
+        stats.fits_palette = palette_open;
+        stats.colors = palette_open ? std::move(table.colors) : std::vector<uint32_t>();
+        if (min_y >= 0) {
+            stats.bounds_x = min_x;
+            stats.bounds_y = min_y;
+            stats.bounds_width = max_x - min_x + 1;
+            stats.bounds_height = max_y - min_y + 1;
+        } else {
+            stats.bounds_x = stats.bounds_y = stats.bounds_width = stats.bounds_height = 0;
+        }
+        stats.alpha_sum = alpha_sum;
+        stats.visible_pixels = visible;
+    }
+
+private:
+    bool grayscale = true;
+    bool opaque = true;
+    bool palette_open = true;
+    ColorTable table;
+    uint64_t alpha_sum = 0;
+    uint64_t visible = 0;
+
+    // Position of the next pixel and bounds of the visible ones
+    const int width;
+    int x = 0;
+    int y = 0;
+    int min_x = INT_MAX;
+    int max_x = -1;
+    int min_y = -1;
+    int max_y = -1;
+};
+
+static void append_be32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void append_png_chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    append_be32(out, static_cast<uint32_t>(size));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if (size) out.insert(out.end(), data, data + size);
+    append_be32(out, stbiw__crc32(out.data() + start, static_cast<int>(size + 4)));
+}
+
+// Insert an oFFs chunk (offset in pixels) right after IHDR, where the spec
+// requires it to precede IDAT
+static void insert_png_offset(std::vector<uint8_t>& png, int x, int y) {
+    constexpr size_t IHDR_END = 8 + 25;
+    if (png.size() < IHDR_END) return;
+    uint8_t data[9];
+    for (int i = 0; i < 4; ++i) {
+        data[i] = static_cast<uint8_t>(static_cast<uint32_t>(x) >> (24 - 8 * i));
+        data[4 + i] = static_cast<uint8_t>(static_cast<uint32_t>(y) >> (24 - 8 * i));
+    }
+    data[8] = 0;  // Unit: pixels
+    std::vector<uint8_t> chunk;
+    append_png_chunk(chunk, "oFFs", data, sizeof(data));
+    png.insert(png.begin() + IHDR_END, chunk.begin(), chunk.end());
+}
+
+// Indexed PNG (colour type 3) at the smallest bit depth that holds the
+// palette. Translucent entries come first so tRNS can stop early.
+static bool encode_png_palette(const ImageData& image, const std::vector<uint32_t>& colors,
+                               std::vector<uint8_t>& out) {
+    std::vector<uint32_t> palette(colors);
+    std::stable_partition(palette.begin(), palette.end(), [](uint32_t c) { return (c >> 24) != 255; });
+    const size_t translucent = static_cast<size_t>(std::count_if(
+        palette.begin(), palette.end(), [](uint32_t c) { return (c >> 24) != 255; }));
+    
+    auto table = std::make_unique<ColorTable>();
+    for (uint32_t color : palette) table->find_or_add(color);
+    
+    const int n = static_cast<int>(palette.size());
+    const int bit_depth = n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8;
+    const size_t row_bytes = (static_cast<size_t>(image.width) * bit_depth + 7) / 8;
+    const size_t filtered_size = (row_bytes + 1) * image.height;
+    if (filtered_size > static_cast<size_t>(INT_MAX)) return false;
+    
+    // Filter type 0 on every row, as recommended for palette images
+    thread_local std::vector<uint8_t> filtered;
+    filtered.assign(filtered_size, 0);
+    const int channels = image.channels;
+    const int per_byte = 8 / bit_depth;
+    for (int y = 0; y < image.height; ++y) {
+        const uint8_t* src = image.row(y);
+        uint8_t* row = filtered.data() + (row_bytes + 1) * y + 1;
+        for (int x = 0; x < image.width; ++x, src += channels) {
+            const uint8_t alpha = channels == 4 ? src[3] : 255;
+            const uint32_t color = src[0] | (src[1] << 8) | (src[2] << 16) | (static_cast<uint32_t>(alpha) << 24);
+            const int index = table->find_or_add(color);
+            if (index < 0) return false;  // Stats did not match the pixels
+            row[x / per_byte] |= static_cast<uint8_t>(index << ((per_byte - 1 - x % per_byte) * bit_depth));
+        }
+    }
+    if (static_cast<int>(table->colors.size()) != n) return false;
+    
+    int zlib_size = 0;
+    unsigned char* zlib = stbi_zlib_compress(filtered.data(), static_cast<int>(filtered_size), &zlib_size,
+                                             stbi_write_png_compression_level);
+    if (!zlib) return false;
+    
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.insert(out.end(), signature, signature + 8);
+    
+    uint8_t ihdr[13];
+    for (int i = 0; i < 4; ++i) {
+        ihdr[i] = static_cast<uint8_t>(static_cast<uint32_t>(image.width) >> (24 - 8 * i));
+        ihdr[4 + i] = static_cast<uint8_t>(static_cast<uint32_t>(image.height) >> (24 - 8 * i));
+    }
+    ihdr[8] = static_cast<uint8_t>(bit_depth);
+    ihdr[9] = 3;  // Indexed colour
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    append_png_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+    
+    uint8_t plte[256 * 3];
+    uint8_t trns[256];
+    for (int i = 0; i < n; ++i) {
+        plte[i * 3 + 0] = static_cast<uint8_t>(palette[i]);
+        plte[i * 3 + 1] = static_cast<uint8_t>(palette[i] >> 8);
+        plte[i * 3 + 2] = static_cast<uint8_t>(palette[i] >> 16);
+        trns[i] = static_cast<uint8_t>(palette[i] >> 24);
+    }
+    append_png_chunk(out, "PLTE", plte, static_cast<size_t>(n) * 3);
+    if (translucent) append_png_chunk(out, "tRNS", trns, translucent);
+    append_png_chunk(out, "IDAT", zlib, static_cast<size_t>(zlib_size));
+    append_png_chunk(out, "IEND", nullptr, 0);
+    STBIW_FREE(zlib);
+    return true;
+}
+
+bool ImageProcessor::encode_png(const ImageData& image, std::vector<uint8_t>& out, const ImageStats* stats) {
+    out.clear();
     if (!image.is_valid()) {
         std::cerr << "Invalid image data" << std::endl;
         return false;
     }
-    
-    fs::path file_path(reinterpret_cast<const char8_t*>(path.c_str()));
-    std::ofstream file(file_path, std::ios::binary);
-    if (!file) return false;
+
+    // Smaller layouts when the kernel pass proved they are exact
+    if (stats && image.channels >= 3) {
+        if (stats->fits_palette && !stats->colors.empty()) {
+            if (encode_png_palette(image, stats->colors, out)) return true;
+            out.clear();
+        } else if (stats->grayscale) {
+            const int channels = image.channels;
+            const int out_channels = (stats->opaque || channels == 3) ? 1 : 2;
+            const size_t gray_stride = static_cast<size_t>(image.width) * out_channels;
+            thread_local std::vector<uint8_t> gray;
+            gray.resize(gray_stride * image.height);
+            for (int y = 0; y < image.height; ++y) {
+                const uint8_t* src = image.row(y);
+                uint8_t* dst = gray.data() + gray_stride * y;
+                for (int x = 0; x < image.width; ++x, src += channels) {
+                    dst[x * out_channels] = src[0];
+                    if (out_channels == 2) dst[x * 2 + 1] = src[3];
+                }
+            }
+            return stbi_write_png_to_func(write_to_vector, &out, image.width, image.height, out_channels,
+                                          gray.data(), image.width * out_channels) != 0;
+        }
+    }
 
     int result = stbi_write_png_to_func(
-        write_to_stream,
-        &file,
+        write_to_vector,
+        &out,
         image.width,
         image.height,
         image.channels,
-        image.pixels.data(),
-        image.width * image.channels
+        image.data(),
+        static_cast<int>(image.stride)
     );
-    
+
     return result != 0;
 }
 
+bool ImageProcessor::encode_image(const ImageData& image, OutputFormat format, std::vector<uint8_t>& out,
+                                  const ImageStats* stats) {
+    switch (format) {
+        case OutputFormat::QOI:
+            if (!encode_qoi(image, out)) {
+                std::cerr << "Invalid image data" << std::endl;
+                return false;
+            }
+            return true;
+        case OutputFormat::RAW:
+            if (!encode_raw(image, out)) {
+                std::cerr << "Invalid image data" << std::endl;
+                return false;
+            }
+            return true;
+        default:
+            return encode_png(image, out, stats);
+    }
+}
+
+const char* ImageProcessor::output_extension(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::QOI: return ".qoi";
+        case OutputFormat::RAW: return ".fbraw";
+        default: return ".png";
+    }
+}
+
+const char* ImageProcessor::output_format_name(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::QOI: return "qoi";
+        case OutputFormat::RAW: return "raw";
+        default: return "png";
+    }
+}
+
+bool ImageProcessor::parse_output_format(const std::string& name, OutputFormat& out) {
+    if (name == "png") out = OutputFormat::PNG;
+    else if (name == "qoi") out = OutputFormat::QOI;
+    else if (name == "raw") out = OutputFormat::RAW;
+    else return false;
+    return true;
+}
+
+bool ImageProcessor::parse_proxy_scales(const std::string& list, std::vector<int>& out) {
+    out.clear();
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        int scale = 0;
+        try {
+            scale = std::stoi(list.substr(start, end - start));
+        } catch (...) {
+            return false;
+        }
+        if (scale < 2 || scale > 64) return false;
+        out.push_back(scale);
+        start = end + 1;
+    }
+    return !out.empty();
+}
+
+const char* ImageProcessor::function_name(ProcessFunction function) {
+    switch (function) {
+        case ProcessFunction::LUMA_TO_ALPHA: return "luma2alpha";
+        case ProcessFunction::LUMA_TO_ALPHA_CUSTOM: return "luma2alpha_custom";
+        case ProcessFunction::CONVERT_TO_PNG: return "png";
+    }
+    return "";
+}
+
+bool ImageProcessor::parse_function(const std::string& name, ProcessFunction& out) {
+    if (name == "luma2alpha") out = ProcessFunction::LUMA_TO_ALPHA;
+    else if (name == "luma2alpha_custom") out = ProcessFunction::LUMA_TO_ALPHA_CUSTOM;
+    else if (name == "png") out = ProcessFunction::CONVERT_TO_PNG;
+    else return false;
+    return true;
+}
+
+bool ImageProcessor::parse_luma_weights(const std::string& text, CustomLumaParams& params) {
+    if (text == "bt601") {
+        params.coef_r = LUMA_COEF_R;
+        params.coef_g = LUMA_COEF_G;
+        params.coef_b = LUMA_COEF_B;
+        return true;
+    }
+    if (text == "bt709") {
+        params.coef_r = LUMA709_COEF_R;
+        params.coef_g = LUMA709_COEF_G;
+        params.coef_b = LUMA709_COEF_B;
+        return true;
+    }
+    float coefs[3];
+    size_t start = 0;
+    for (int i = 0; i < 3; ++i) {
+        size_t end = text.find(',', start);
+        if ((end == std::string::npos) != (i == 2)) return false;
+        if (end == std::string::npos) end = text.size();
+        try {
+            size_t used = 0;
+            coefs[i] = std::stof(text.substr(start, end - start), &used);
+            if (used != end - start) return false;
+        } catch (...) {
+            return false;
+        }
+        start = end + 1;
+    }
+    params.coef_r = coefs[0];
+    params.coef_g = coefs[1];
+    params.coef_b = coefs[2];
+    return true;
+}
+
+bool ImageProcessor::parse_target_spec(const std::string& spec, OutputTarget& target) {
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        const std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+        
+        const size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        const std::string key = item.substr(0, eq);
+        const std::string value = item.substr(eq + 1);
+        try {
+            if (key == "output") {
+                if (value.empty()) return false;
+                target.output_dir = value;
+            } else if (key == "function") {
+                if (!parse_function(value, target.function)) return false;
+            } else if (key == "threshold" && value == "auto") {
+                target.auto_threshold = true;
+            } else if (key == "threshold") {
+                const int threshold = std::stoi(value);
+                target.auto_threshold = false;
+                if (threshold < 0 || threshold > 255) return false;
+                target.luma_threshold = static_cast<uint8_t>(threshold);
+                target.custom_params.threshold = static_cast<uint8_t>(threshold);
+            } else if (key == "coef_r") {
+                target.custom_params.coef_r = std::stof(value);
+            } else if (key == "coef_g") {
+                target.custom_params.coef_g = std::stof(value);
+            } else if (key == "coef_b") {
+                target.custom_params.coef_b = std::stof(value);
+            } else if (key == "weights") {
+                if (value != "bt601" && value != "bt709") return false;
+                parse_luma_weights(value, target.custom_params);
+            } else if (key == "linear") {
+                if (value != "0" && value != "1") return false;
+                target.custom_params.linear = value == "1";
+            } else if (key == "output_format") {
+                if (!parse_output_format(value, target.output_format)) return false;
+            } else if (key == "keep_rgba" || key == "trim") {
+                if (value != "0" && value != "1") return false;
+                (key == "trim" ? target.trim : target.keep_rgba) = value == "1";
+            } else {
+                return false;
+            }
+        } catch (...) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ImageProcessor::format_target_spec(const OutputTarget& target) {
+    const bool custom = target.function == ProcessFunction::LUMA_TO_ALPHA_CUSTOM;
+    std::ostringstream spec;
+    spec << "output=" << target.output_dir
+         << ",function=" << function_name(target.function);
+    if (target.auto_threshold) {
+        spec << ",threshold=auto";
+    } else {
+        spec << ",threshold=" << static_cast<int>(custom ? target.custom_params.threshold : target.luma_threshold);
+    }
+    spec << ",coef_r=" << target.custom_params.coef_r
+         << ",coef_g=" << target.custom_params.coef_g
+         << ",coef_b=" << target.custom_params.coef_b
+         << ",linear=" << (target.custom_params.linear ? 1 : 0)
+         << ",output_format=" << output_format_name(target.output_format)
+         << ",keep_rgba=" << (target.keep_rgba ? 1 : 0)
+         << ",trim=" << (target.trim ? 1 : 0);
+    return spec.str();
+}
+
+ImageProcessor::OutputTarget ImageProcessor::BatchOptions::main_target() const {
+    OutputTarget target;
+    target.output_dir = output_dir;
+    target.function = function;
+    target.luma_threshold = luma_threshold;
+    target.custom_params = custom_params;
+    target.auto_threshold = auto_threshold;
+    target.output_format = output_format;
+    target.keep_rgba = keep_rgba;
+    target.trim = trim;
+    return target;
+}
+
+void ImageProcessor::BatchOptions::set_main_target(const OutputTarget& target) {
+    output_dir = target.output_dir;
+    function = target.function;
+    luma_threshold = target.luma_threshold;
+    custom_params = target.custom_params;
+    auto_threshold = target.auto_threshold;
+    output_format = target.output_format;
+    keep_rgba = target.keep_rgba;
+    trim = target.trim;
+}
+
+bool ImageProcessor::load_job_list(const std::string& path, const BatchOptions& defaults,
+                                   std::vector<BatchOptions>& jobs) {
+    std::ifstream in(fs::path(reinterpret_cast<const char8_t*>(path.c_str())));
+    if (!in) {
+        std::cerr << "Cannot open job list: " << path << std::endl;
+        return false;
+    }
+    
+    auto split = [](const std::string& line) {
+        std::vector<std::string> cells;
+        size_t start = 0;
+        while (true) {
+            size_t end = line.find(',', start);
+            cells.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            if (end == std::string::npos) return cells;
+            start = end + 1;
+        }
+    };
+    
+    std::vector<std::string> columns;
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        
+        std::vector<std::string> cells = split(line);
+        if (columns.empty()) {
+            columns = std::move(cells);
+            continue;
+        }
+        if (cells.size() > columns.size()) {
+            std::cerr << path << ":" << line_number << ": more cells than header columns" << std::endl;
+            return false;
+        }
+        
+        // The row becomes a target spec for the job's (only) output
+        BatchOptions job = defaults;
+        job.input_dir.clear();
+        job.extra_targets.clear();
+        OutputTarget target = job.main_target();
+        target.output_dir.clear();
+        std::string spec;
+        for (size_t i = 0; i < cells.size(); ++i) {
+            if (cells[i].empty()) continue;
+            if (columns[i] == "input") {
+                job.input_dir = cells[i];
+            } else {
+                spec += columns[i] + "=" + cells[i] + ",";
+            }
+        }
+        if (!parse_target_spec(spec, target) || job.input_dir.empty() || target.output_dir.empty()) {
+            std::cerr << path << ":" << line_number << ": invalid job (input and output are required)" << std::endl;
+            return false;
+        }
+        job.set_main_target(target);
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
 ImageFormat ImageProcessor::detect_format(const std::string& path) {
     fs::path p(reinterpret_cast<const char8_t*>(path.c_str()));
     std::string ext = p.extension().string();
@@ -100,235 +646,243 @@ ImageFormat ImageProcessor::detect_format(const std::string& path) {
     if (ext == ".tga") return ImageFormat::TGA;
     if (ext == ".jpg" || ext == ".jpeg") return ImageFormat::JPEG;
     if (ext == ".bmp") return ImageFormat::BMP;
+    if (ext == ".qoi") return ImageFormat::QOI;
+    if (ext == ".fbraw") return ImageFormat::RAW;
     
     return ImageFormat::UNKNOWN;
 }
 
-uint8_t ImageProcessor::calculate_luminance(uint8_t r, uint8_t g, uint8_t b) {
-    // L = 0.299*R + 0.587*G + 0.114*B
-    float luma = LUMA_COEF_R * r + LUMA_COEF_G * g + LUMA_COEF_B * b;
-    return static_cast<uint8_t>(std::clamp(luma, 0.0f, 255.0f));
-}
-
-uint8_t ImageProcessor::calculate_luminance_custom(uint8_t r, uint8_t g, uint8_t b,
-                                                   float coef_r, float coef_g, float coef_b) {
-    // Custom: L = coef_r*R + coef_g*G + coef_b*B
-    float luma = coef_r * r + coef_g * g + coef_b * b;
-    return static_cast<uint8_t>(std::clamp(luma, 0.0f, 255.0f));
+bool ImageProcessor::is_passthrough_png(const uint8_t* header, size_t size) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (!header || size < 33 || std::memcmp(header, signature, 8) != 0) return false;
+    
+    // First chunk must be a 13-byte IHDR
+    const uint8_t* ihdr = header + 8;
+    if (std::memcmp(ihdr, "\0\0\0\x0DIHDR", 8) != 0) return false;
+    
+    const uint8_t bit_depth = ihdr[16];
+    const uint8_t color_type = ihdr[17];
+    const bool known_color_type = color_type == 0 || color_type == 2 || color_type == 3 ||
+                                  color_type == 4 || color_type == 6;
+    return known_color_type && bit_depth >= 1 && bit_depth <= 8;
 }
 
-ImageData ImageProcessor::luma_to_alpha(const ImageData& input, uint8_t threshold) {
-    if (!input.is_valid()) {
-        return ImageData{};
+// Luminance L = coef_r*R + coef_g*G + coef_b*B as three table lookups: each
+// table holds one channel's weighted value for every 8-bit input, with the
+// sRGB decoding folded in for linear light, so no pow() runs per pixel and
+// every variant costs the same. The products and their sum are the same
+// float operations as weighting each pixel directly, so the results match
+// the per-pixel formula bit for bit.
+class LumaTables {
+public:
+    LumaTables(float coef_r, float coef_g, float coef_b, bool linear) {
+        for (int v = 0; v < 256; ++v) {
+            const float value = linear ? srgb_to_linear(v) : static_cast<float>(v);
+            red[v] = coef_r * value;
+            green[v] = coef_g * value;
+            blue[v] = coef_b * value;
+        }
     }
     
-    // First, convert input to RGBA format (normalize to have alpha channel)
-    ImageData rgba_input;
-    rgba_input.width = input.width;
-    rgba_input.height = input.height;
-    rgba_input.channels = 4; // RGBA
-    rgba_input.pixels.resize(input.width * input.height * 4);
-    
-    const int pixel_count = input.width * input.height;
+    explicit LumaTables(const CustomLumaParams& params)
+        : LumaTables(params.coef_r, params.coef_g, params.coef_b, params.linear) {}
     
-    // Convert input to RGBA first
-    for (int i = 0; i < pixel_count; ++i) {
-        uint8_t r, g, b, a = 255; // Default alpha to opaque
-        
-        if (input.channels == 1) {
-            // Grayscale input -> RGB
-            r = g = b = input.pixels[i];
-        } else if (input.channels == 2) {
-            // Grayscale + Alpha input
-            r = g = b = input.pixels[i * 2 + 0];
-            a = input.pixels[i * 2 + 1];
-        } else if (input.channels == 3) {
-            // RGB input
-            r = input.pixels[i * 3 + 0];
-            g = input.pixels[i * 3 + 1];
-            b = input.pixels[i * 3 + 2];
-        } else if (input.channels == 4) {
-            // RGBA input
-            r = input.pixels[i * 4 + 0];
-            g = input.pixels[i * 4 + 1];
-            b = input.pixels[i * 4 + 2];
-            a = input.pixels[i * 4 + 3];
-        } else {
-            // Invalid channel count, skip
-            continue;
-        }
-        
-        // Store as RGBA
-        rgba_input.pixels[i * 4 + 0] = r;
-        rgba_input.pixels[i * 4 + 1] = g;
-        rgba_input.pixels[i * 4 + 2] = b;
-        rgba_input.pixels[i * 4 + 3] = a;
+    uint8_t operator()(uint8_t r, uint8_t g, uint8_t b) const {
+        const float luma = red[r] + green[g] + blue[b];
+        return static_cast<uint8_t>(std::clamp(luma, 0.0f, 255.0f));
     }
     
-    // Now convert luminance to alpha channel
-    ImageData output;
-    output.width = rgba_input.width;
-    output.height = rgba_input.height;
-    output.channels = 4; // RGBA
-    output.pixels.resize(rgba_input.width * rgba_input.height * 4);
+private:
+    // sRGB transfer function inverted, scaled back to 0-255
+    static float srgb_to_linear(int v) {
+        const double encoded = v / 255.0;
+        const double linear = encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+        return static_cast<float>(linear * 255.0);
+    }
     
-    int scalar_start_index = 0;
+    float red[256];
+    float green[256];
+    float blue[256];
+};
 
-#ifdef ENABLE_SIMD
-    // 将来的にここにSIMD実装を追加し、処理済みピクセル数を scalar_start_index に設定します
-    // scalar_start_index = (pixel_count / 8) * 8;
-    // ... SIMD loop ...
-#endif
+// Reads one pixel of a 1-4 channel image as RGBA
+static inline void load_rgba(const uint8_t* src, int channels, uint8_t& r, uint8_t& g, uint8_t& b, uint8_t& a) {
+    if (channels == 1) {
+        // Grayscale input -> RGB
+        r = g = b = src[0];
+        a = 255;
+    } else if (channels == 2) {
+        // Grayscale + Alpha input
+        r = g = b = src[0];
+        a = src[1];
+    } else if (channels == 3) {
+        // RGB input
+        r = src[0];
+        g = src[1];
+        b = src[2];
+        a = 255;
+    } else {
+        // RGBA input
+        r = src[0];
+        g = src[1];
+        b = src[2];
+        a = src[3];
+    }
+}
 
-    for (int i = scalar_start_index; i < pixel_count; ++i) {
-        uint8_t r = rgba_input.pixels[i * 4 + 0];
-        uint8_t g = rgba_input.pixels[i * 4 + 1];
-        uint8_t b = rgba_input.pixels[i * 4 + 2];
-        
-        // Calculate luminance from RGB.
-        // User intent: "luminance -> transparency" (brighter = more transparent),
-        // so alpha should be inverted: alpha = 255 - luminance.
-        uint8_t luma = calculate_luminance(r, g, b);
-        
+// Alpha for each luminance value at `threshold`
+static void build_alpha_table(uint8_t threshold, uint8_t* alpha_of) {
+    for (int luma = 0; luma < 256; ++luma) {
         // Threshold logic: if luminance is below threshold, preserve original color fully (alpha = 255)
         // Otherwise, apply transparency based on luminance
-        uint8_t alpha;
         if (luma < threshold) {
             // Below threshold: keep original color (fully opaque)
-            alpha = 255;
+            alpha_of[luma] = 255;
         } else {
             // Above threshold: apply transparency (brighter = more transparent)
             // Map threshold..255 to 255..0
             int range = 255 - threshold;
             if (range == 0) range = 1; // Avoid division by zero
-            uint8_t mapped_luma = static_cast<uint8_t>(
+            alpha_of[luma] = static_cast<uint8_t>(
                 255 - ((static_cast<uint16_t>(luma - threshold) * 255) / range)
             );
-            alpha = mapped_luma;
         }
-        
-        // If the source already had alpha, preserve it by multiplying:
-        // final_alpha = alpha * src_alpha / 255
-        uint8_t src_a = rgba_input.pixels[i * 4 + 3];
-        uint8_t final_alpha = static_cast<uint8_t>(
-            (static_cast<uint16_t>(alpha) * static_cast<uint16_t>(src_a)) / 255
-        );
-
-        output.pixels[i * 4 + 0] = r;
-        output.pixels[i * 4 + 1] = g;
-        output.pixels[i * 4 + 2] = b;
-        output.pixels[i * 4 + 3] = final_alpha;
     }
-    
-    return output;
 }
 
-ImageData ImageProcessor::luma_to_alpha_custom(const ImageData& input, const CustomLumaParams& params) {
+// Luminance -> transparency kernel shared by the luma functions.
+// User intent: "luminance -> transparency" (brighter = more transparent).
+// A negative threshold selects it per image with Otsu's method; that needs
+// the whole histogram first, so the pass parks each pixel's luminance in
+// its alpha byte and a second pass over the output maps it.
+template <typename Luminance>
+static ImageData luma_kernel(const ImageData& input, const Luminance& luminance, int threshold, ImageStats* stats) {
     if (!input.is_valid()) {
         return ImageData{};
     }
     
-    // First, convert input to RGBA format (normalize to have alpha channel)
-    ImageData rgba_input;
-    rgba_input.width = input.width;
-    rgba_input.height = input.height;
-    rgba_input.channels = 4; // RGBA
-    rgba_input.pixels.resize(input.width * input.height * 4);
-    
-    const int pixel_count = input.width * input.height;
-    
-    // Convert input to RGBA first
-    for (int i = 0; i < pixel_count; ++i) {
-        uint8_t r, g, b, a = 255; // Default alpha to opaque
-        
-        if (input.channels == 1) {
-            // Grayscale input -> RGB
-            r = g = b = input.pixels[i];
-        } else if (input.channels == 2) {
-            // Grayscale + Alpha input
-            r = g = b = input.pixels[i * 2 + 0];
-            a = input.pixels[i * 2 + 1];
-        } else if (input.channels == 3) {
-            // RGB input
-            r = input.pixels[i * 3 + 0];
-            g = input.pixels[i * 3 + 1];
-            b = input.pixels[i * 3 + 2];
-        } else if (input.channels == 4) {
-            // RGBA input
-            r = input.pixels[i * 4 + 0];
-            g = input.pixels[i * 4 + 1];
-            b = input.pixels[i * 4 + 2];
-            a = input.pixels[i * 4 + 3];
-        } else {
-            // Invalid channel count, skip
-            continue;
-        }
-        
-        // Store as RGBA
-        rgba_input.pixels[i * 4 + 0] = r;
-        rgba_input.pixels[i * 4 + 1] = g;
-        rgba_input.pixels[i * 4 + 2] = b;
-        rgba_input.pixels[i * 4 + 3] = a;
+    // The output is always RGBA; every byte is written below, so the
+    // buffer is not initialised first
+    ImageData output = ImageData::allocate(input.width, input.height, 4);
+    if (!output.is_valid()) {
+        return ImageData{};
     }
     
-    // Now convert luminance to alpha channel (using custom coefficients)
-    ImageData output;
-    output.width = rgba_input.width;
-    output.height = rgba_input.height;
-    output.channels = 4; // RGBA
-    output.pixels.resize(rgba_input.width * rgba_input.height * 4);
+    const bool auto_threshold = threshold < 0;
+    uint8_t alpha_of[256];
+    if (!auto_threshold) build_alpha_table(static_cast<uint8_t>(threshold), alpha_of);
+    
+    std::unique_ptr<StatsCollector> collector;
+    if (stats) collector = std::make_unique<StatsCollector>(output.width);
+    const bool count_luma = stats || auto_threshold;
+    std::array<uint32_t, 256> histogram{};
     
-    int scalar_start_index = 0;
+    for (int y = 0; y < input.height; ++y) {
+        const uint8_t* src = input.row(y);
+        uint8_t* dst = output.row(y);
+        int scalar_start_index = 0;
 
 #ifdef ENABLE_SIMD
-    // 将来的にここにSIMD実装を追加し、処理済みピクセル数を scalar_start_index に設定します
-    // scalar_start_index = (pixel_count / 8) * 8;
-    // ... SIMD loop ...
+        // 将来的にここにSIMD実装を追加し、処理済みピクセル数を scalar_start_index に設定します
+        // scalar_start_index = (input.width / 8) * 8;
+        // ... SIMD loop ...
 #endif
 
-    for (int i = scalar_start_index; i < pixel_count; ++i) {
-        uint8_t r = rgba_input.pixels[i * 4 + 0];
-        uint8_t g = rgba_input.pixels[i * 4 + 1];
-        uint8_t b = rgba_input.pixels[i * 4 + 2];
-        
-        // Calculate luminance from RGB using custom coefficients.
-        // User intent: "luminance -> transparency" (brighter = more transparent),
-        // so alpha should be inverted: alpha = 255 - luminance.
-        uint8_t luma = calculate_luminance_custom(r, g, b, params.coef_r, params.coef_g, params.coef_b);
-        
-        // Threshold logic: if luminance is below threshold, preserve original color fully (alpha = 255)
-        // Otherwise, apply transparency based on luminance
-        uint8_t alpha;
-        if (luma < params.threshold) {
-            // Below threshold: keep original color (fully opaque)
-            alpha = 255;
-        } else {
-            // Above threshold: apply transparency (brighter = more transparent)
-            // Map threshold..255 to 255..0
-            int range = 255 - params.threshold;
-            if (range == 0) range = 1; // Avoid division by zero
-            uint8_t mapped_luma = static_cast<uint8_t>(
-                255 - ((static_cast<uint16_t>(luma - params.threshold) * 255) / range)
+        src += static_cast<size_t>(scalar_start_index) * input.channels;
+        for (int x = scalar_start_index; x < input.width; ++x, src += input.channels) {
+            uint8_t r, g, b, src_a;
+            load_rgba(src, input.channels, r, g, b, src_a);
+            
+            const uint8_t luma = luminance(r, g, b);
+            if (count_luma) ++histogram[luma];
+            
+            dst[x * 4 + 0] = r;
+            dst[x * 4 + 1] = g;
+            dst[x * 4 + 2] = b;
+            if (auto_threshold) {
+                dst[x * 4 + 3] = luma;
+                continue;
+            }
+            
+            // If the source already had alpha, preserve it by multiplying:
+            // final_alpha = alpha * src_alpha / 255
+            const uint8_t final_alpha = static_cast<uint8_t>(
+                (static_cast<uint16_t>(alpha_of[luma]) * static_cast<uint16_t>(src_a)) / 255
             );
-            alpha = mapped_luma;
+            dst[x * 4 + 3] = final_alpha;
+            if (collector) collector->add(r, g, b, final_alpha);
+        }
+    }
+    
+    if (auto_threshold) {
+        threshold = ImageProcessor::otsu_threshold(histogram);
+        build_alpha_table(static_cast<uint8_t>(threshold), alpha_of);
+        for (int y = 0; y < input.height; ++y) {
+            const uint8_t* src = input.row(y);
+            uint8_t* dst = output.row(y);
+            for (int x = 0; x < input.width; ++x, src += input.channels, dst += 4) {
+                const uint8_t src_a = input.channels == 2 ? src[1] : input.channels == 4 ? src[3] : 255;
+                const uint8_t final_alpha = static_cast<uint8_t>(
+                    (static_cast<uint16_t>(alpha_of[dst[3]]) * static_cast<uint16_t>(src_a)) / 255
+                );
+                dst[3] = final_alpha;
+                if (collector) collector->add(dst[0], dst[1], dst[2], final_alpha);
+            }
         }
-        
-        // If the source already had alpha, preserve it by multiplying:
-        // final_alpha = alpha * src_alpha / 255
-        uint8_t src_a = rgba_input.pixels[i * 4 + 3];
-        uint8_t final_alpha = static_cast<uint8_t>(
-            (static_cast<uint16_t>(alpha) * static_cast<uint16_t>(src_a)) / 255
-        );
-
-        output.pixels[i * 4 + 0] = r;
-        output.pixels[i * 4 + 1] = g;
-        output.pixels[i * 4 + 2] = b;
-        output.pixels[i * 4 + 3] = final_alpha;
     }
     
+    if (collector) {
+        collector->finish(*stats);
+        stats->luma_histogram = histogram;
+        stats->threshold = threshold;
+    }
     return output;
 }
 
+uint8_t ImageProcessor::otsu_threshold(const std::array<uint32_t, 256>& histogram) {
+    uint64_t total = 0;
+    double sum_all = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        total += histogram[i];
+        sum_all += static_cast<double>(i) * histogram[i];
+    }
+    
+    // Maximise the between-class variance w0 * w1 * (m0 - m1)^2 over the
+    // split "luma <= t" / "luma > t"
+    uint64_t weight_low = 0;
+    double sum_low = 0.0;
+    double best_variance = 0.0;
+    int best_split = -1;
+    for (int t = 0; t < 255; ++t) {
+        weight_low += histogram[t];
+        sum_low += static_cast<double>(t) * histogram[t];
+        const uint64_t weight_high = total - weight_low;
+        if (weight_low == 0 || weight_high == 0) continue;
+        
+        const double mean_low = sum_low / weight_low;
+        const double mean_high = (sum_all - sum_low) / weight_high;
+        const double variance = static_cast<double>(weight_low) * weight_high * (mean_low - mean_high) * (mean_low - mean_high);
+        if (variance > best_variance) {
+            best_variance = variance;
+            best_split = t;
+        }
+    }
+    
+    // The kernel keeps "luma < threshold" opaque, so the dark class ends at threshold - 1
+    return best_split < 0 ? DEFAULT_LUMA_THRESHOLD : static_cast<uint8_t>(best_split + 1);
+}
+
+ImageData ImageProcessor::luma_to_alpha(const ImageData& input, uint8_t threshold, ImageStats* stats) {
+    // L = 0.299*R + 0.587*G + 0.114*B
+    return luma_kernel(input, LumaTables(LUMA_COEF_R, LUMA_COEF_G, LUMA_COEF_B, false), threshold, stats);
+}
+
+ImageData ImageProcessor::luma_to_alpha_custom(const ImageData& input, const CustomLumaParams& params,
+                                                ImageStats* stats) {
+    // Custom coefficients: L = coef_r*R + coef_g*G + coef_b*B (optionally in linear light)
+    return luma_kernel(input, LumaTables(params), params.threshold, stats);
+}
+
 ImageData ImageProcessor::convert_to_png(const ImageData& input) {
     // Simply return a copy - conversion happens during save
     return input;
@@ -350,18 +904,535 @@ ImageData ImageProcessor::process(const ImageData& input, ProcessFunction func)
     }
 }
 
+// fs::path <-> UTF-8 std::string
+static std::string to_utf8(const fs::path& path) {
+    std::u8string u8path = path.u8string();
+    return std::string(reinterpret_cast<const char*>(u8path.c_str()));
+}
+
+static fs::path output_path_for(const fs::path& input_path, const fs::path& output_dir, OutputFormat format) {
+    fs::path output_path = output_dir / input_path.filename();
+    output_path.replace_extension(ImageProcessor::output_extension(format));
+    return output_path;
+}
+
+// <stem>_proxy<N>.<ext> next to the full-size output
+static fs::path proxy_path_for(const fs::path& input_path, const fs::path& output_dir, OutputFormat format, int scale) {
+    fs::path name = input_path.stem();
+    name += "_proxy" + std::to_string(scale);
+    name += ImageProcessor::output_extension(format);
+    return output_dir / name;
+}
+
+ImageData ImageProcessor::apply_function(const ImageData& input, const BatchOptions& options, ImageStats* stats) {
+    if (options.auto_threshold && options.function == ProcessFunction::LUMA_TO_ALPHA) {
+        return luma_kernel(input, LumaTables(LUMA_COEF_R, LUMA_COEF_G, LUMA_COEF_B, false), -1, stats);
+    } else if (options.auto_threshold && options.function == ProcessFunction::LUMA_TO_ALPHA_CUSTOM) {
+        return luma_kernel(input, LumaTables(options.custom_params), -1, stats);
+    } else if (options.function == ProcessFunction::LUMA_TO_ALPHA) {
+        return luma_to_alpha(input, options.luma_threshold, stats);
+    } else if (options.function == ProcessFunction::LUMA_TO_ALPHA_CUSTOM) {
+        return luma_to_alpha_custom(input, options.custom_params, stats);
+    }
+    return process(input, options.function);
+}
+
+bool ImageProcessor::transcode(const ImageData& input_image, const BatchOptions& options,
+                               std::vector<uint8_t>& encoded, TrimRect* trim, ImageStats* stats_out,
+                               std::vector<std::vector<uint8_t>>* proxies) {
+    // Process image; the kernel also reports whether a gray or indexed PNG
+    // can hold the result, and where the visible pixels are
+    const bool pick_layout = options.output_format == OutputFormat::PNG && !options.keep_rgba;
+    const bool trimming = options.trim && options.function != ProcessFunction::CONVERT_TO_PNG;
+    ImageStats local_stats;
+    ImageStats& stats = stats_out ? *stats_out : local_stats;
+    ImageData output_image;
+    {
+        TraceSpan span(options.tracer, "kernel");
+        output_image = apply_function(input_image, options, (pick_layout || trimming || stats_out) ? &stats : nullptr);
+    }
+    if (!output_image.is_valid()) return false;
+    
+    // Keep only the bounding box; a fully transparent image becomes one
+    // transparent pixel at the origin
+    TrimRect rect{0, 0, output_image.width, output_image.height, output_image.width, output_image.height};
+    if (trimming) {
+        if (stats.bounds_width > 0) {
+            rect.x = stats.bounds_x;
+            rect.y = stats.bounds_y;
+            rect.width = stats.bounds_width;
+            rect.height = stats.bounds_height;
+        } else {
+            rect.width = rect.height = 1;
+        }
+        if (rect.width != output_image.width || rect.height != output_image.height) {
+            output_image = output_image.view(rect.x, rect.y, rect.width, rect.height);
+        }
+    }
+    
+    // Encode in the requested output format
+    TraceSpan span(options.tracer, "encode");
+    if (!encode_image(output_image, options.output_format, encoded, pick_layout ? &stats : nullptr)) {
+        return false;
+    }
+    if (trimming) {
+        if (options.output_format == OutputFormat::PNG) insert_png_offset(encoded, rect.x, rect.y);
+        if (trim) *trim = rect;
+    }
+    
+    // Proxies come from the pixels still in memory. Resampling keeps gray
+    // images gray (and opaque ones opaque) but mixes new colours, so only
+    // the gray layout carries over from the full-size image.
+    if (proxies) {
+        ImageStats proxy_stats;
+        proxy_stats.grayscale = stats.grayscale;
+        proxy_stats.opaque = stats.opaque;
+        for (size_t i = 0; i < options.proxy_scales.size() && i < proxies->size(); ++i) {
+            const int scale = options.proxy_scales[i];
+            ImageData proxy;
+            {
+                TraceSpan resize_span(options.tracer, "resize");
+                proxy = resize_image(output_image, (output_image.width + scale - 1) / scale,
+                                     (output_image.height + scale - 1) / scale, options.proxy_filter);
+            }
+            if (!proxy.is_valid() ||
+                !encode_image(proxy, options.output_format, (*proxies)[i], pick_layout ? &proxy_stats : nullptr)) {
+                (*proxies)[i].clear();
+            }
+        }
+    }
+    return true;
+}
+
+// CSV file in an output directory that gets one line per finished file.
+// Opened on first use; new files start with `header`. Each line is flushed
+// on its own so processes sharing the output directory (claim mode)
+// interleave whole lines. A later line for the same name wins.
+class CsvAppender {
+public:
+    CsvAppender(fs::path path, std::string header) : path(std::move(path)), header(std::move(header)) {}
+    
+    // `fields` follow the name column, already comma-separated
+    void append(const std::string& name, const std::string& fields) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file.is_open()) {
+            std::error_code ec;
+            const bool fresh = !fs::exists(path, ec) || fs::file_size(path, ec) == 0;
+            file.open(path, std::ios::app);
+            if (!file) {
+                std::cerr << "Failed to open " << to_utf8(path) << std::endl;
+                return;
+            }
+            if (fresh) file << header << '\n';
+        }
+        
+        if (name.find_first_of(",\"\n") != std::string::npos) {
+            file << '"';
+            for (char c : name) {
+                if (c == '"') file << '"';
+                file << c;
+            }
+            file << '"';
+        } else {
+            file << name;
+        }
+        file << ',' << fields << '\n';
+        file.flush();
+    }
+    
+private:
+    fs::path path;
+    std::string header;
+    std::mutex mutex;
+    std::ofstream file;
+};
+
+// File pipeline shared by batch and watch modes:
+// async read -> decode on a worker -> process/encode for every output target -> async write.
+// Runs on a BatchEngine that may be shared with other pipelines.
+class FilePipeline {
+public:
+    // `ok` is false if any output of the file was not written
+    using DoneCallback = std::function<void(const fs::path& input_path, bool ok)>;
+    
+    FilePipeline(const ImageProcessor::BatchOptions& options, fs::path output_dir, BatchEngine& engine,
+                 BatchJournal* journal = nullptr)
+        : options(options),
+          engine(engine),
+          journal(journal) {
+        // Each target runs with a copy of the options carrying its own output settings
+        targets.push_back(std::make_unique<Target>(options, std::move(output_dir)));
+        for (const auto& extra : options.extra_targets) {
+            ImageProcessor::BatchOptions target_options = options;
+            target_options.set_main_target(extra);
+            target_options.extra_targets.clear();
+            targets.push_back(std::make_unique<Target>(
+                std::move(target_options), fs::path(reinterpret_cast<const char8_t*>(extra.output_dir.c_str()))));
+        }
+    }
+    
+    // Queue one file; `done` runs once every output is written, it failed, or
+    // the batch was cancelled. Blocks while too many files have been read but
+    // not yet processed, so a fast device cannot pull the whole input set
+    // into memory.
+    void submit(const fs::path& input_path, DoneCallback done) {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            // Follows the engine's current worker count when it is adaptive
+            auto has_room = [&] { return pending < engine.thread_count() * 4; };
+            if (!has_room()) {
+                TraceSpan span(options.tracer, "backpressure");
+                state_condition.wait(lock, has_room);
+            }
+            ++pending;
+            ++outstanding;
+        }
+        
+        std::vector<Target*> all;
+        bool any_passthrough = false;
+        for (const auto& target : targets) {
+            all.push_back(target.get());
+            any_passthrough |= may_pass_through(*target, input_path);
+        }
+        
+        // PNG -> PNG: copy the bytes instead of decoding and re-encoding;
+        // only the remaining targets need the decoded pixels
+        if (any_passthrough) {
+            const int64_t queued_at = trace_start();
+            engine.pool().enqueue([this, input_path, all, done, queued_at]() {
+                trace_wait("queue", queued_at, input_path);
+                TraceSpan span(options.tracer, "passthrough", trace_name(input_path));
+                if (cancelled()) {
+                    release_pending();
+                    finish(input_path, done, false);
+                    return;
+                }
+                std::vector<Target*> remaining;
+                const bool eligible = is_passthrough_source(input_path);
+                for (Target* target : all) {
+                    if (!eligible || !may_pass_through(*target, input_path) || !try_passthrough(*target, input_path)) {
+                        remaining.push_back(target);
+                    }
+                }
+                if (remaining.empty()) {
+                    release_pending();
+                    finish(input_path, done, true);
+                    return;
+                }
+                read_and_process(input_path, std::move(remaining), done);
+            });
+            return;
+        }
+        
+        read_and_process(input_path, std::move(all), done);
+    }
+    
+    bool cancelled() const {
+        return options.cancel_flag && options.cancel_flag->load();
+    }
+    
+    // True if the resumed journal holds every output of `input_path`
+    bool journaled(const fs::path& input_path) const {
+        if (!journal) return false;
+        for (const auto& target : targets) {
+            const OutputFormat format = target->options.output_format;
+            if (!journal->is_done(to_utf8(output_path_for(input_path, target->output_dir, format)))) return false;
+            for (int scale : target->options.proxy_scales) {
+                if (!journal->is_done(to_utf8(proxy_path_for(input_path, target->output_dir, format, scale)))) return false;
+            }
+        }
+        return true;
+    }
+    
+    // Wait until every submitted file of this pipeline has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        state_condition.wait(lock, [&] { return outstanding == 0; });
+    }
+    
+private:
+    struct Target {
+        Target(ImageProcessor::BatchOptions options, fs::path output_dir)
+            : options(std::move(options)),
+              output_dir(output_dir),
+              trim_manifest(output_dir / TRIM_MANIFEST_NAME, "name,x,y,width,height,canvas_width,canvas_height"),
+              report(output_dir / REPORT_NAME,
+                     "name,width,height,threshold,alpha_coverage,visible_fraction,luma_mean") {}
+        
+        ImageProcessor::BatchOptions options;
+        fs::path output_dir;
+        CsvAppender trim_manifest;
+        CsvAppender report;
+    };
+    
+    static bool may_pass_through(const Target& target, const fs::path& input_path) {
+        return target.options.function == ProcessFunction::CONVERT_TO_PNG && !target.options.force_reencode &&
+               target.options.output_format == OutputFormat::PNG && target.options.proxy_scales.empty() &&
+               ImageProcessor::detect_format(to_utf8(input_path)) == ImageFormat::PNG;
+    }
+    
+    // True if the PNG at input_path may be copied unchanged
+    static bool is_passthrough_source(const fs::path& input_path) {
+        std::vector<uint8_t> header;
+        return AsyncFileIO::read_file_prefix_sync(to_utf8(input_path), 33, header) &&
+               ImageProcessor::is_passthrough_png(header.data(), header.size());
+    }
+    
+    bool try_passthrough(const Target& target, const fs::path& input_path) {
+        const std::string source = to_utf8(input_path);
+        const std::string destination = to_utf8(output_path_for(input_path, target.output_dir, target.options.output_format));
+        if (!AsyncFileIO::copy_file_sync(source, destination)) return false;
+        if (target.options.drop_cache) {
+            AsyncFileIO::drop_cached_pages(source);
+            AsyncFileIO::drop_cached_pages(destination);
+        }
+        if (journal) {
+            std::error_code ec;
+            const uintmax_t size = fs::file_size(fs::path(reinterpret_cast<const char8_t*>(destination.c_str())), ec);
+            if (!ec) journal->record(destination, size, "-");
+        }
+        return true;
+    }
+    
+    void read_and_process(const fs::path& input_path, std::vector<Target*> file_targets, const DoneCallback& done) {
+        std::string input_path_str = to_utf8(input_path);
+        const int64_t read_start = trace_start();
+        engine.io().read_file(input_path_str, [this, input_path, input_path_str, file_targets = std::move(file_targets), done, read_start](std::vector<uint8_t>&& data, bool ok) {
+            trace_wait("read", read_start, input_path);
+            if (!ok) {
+                std::cerr << "Failed to open file: " << input_path_str << std::endl;
+                // `done` may be slow (claim files on a network share): not on the I/O thread
+                engine.pool().enqueue([this, input_path, done]() {
+                    release_pending();
+                    finish(input_path, done, false);
+                });
+                return;
+            }
+            
+            const int64_t queued_at = trace_start();
+            engine.pool().enqueue([this, input_path, input_path_str, file_targets, done, queued_at, data = std::move(data)]() mutable {
+                trace_wait("queue", queued_at, input_path);
+                TraceSpan file_span(options.tracer, "process", trace_name(input_path));
+                if (cancelled()) {
+                    release_pending();
+                    finish(input_path, done, false);
+                    return;
+                }
+                
+                // Decode once; every target runs its kernel on the same pixels
+                ImageData input_image;
+                {
+                    TraceSpan span(options.tracer, "decode");
+                    input_image = ImageProcessor::decode_image(data.data(), data.size());
+                }
+                std::vector<uint8_t>().swap(data);
+                if (!input_image.is_valid()) {
+                    std::cerr << "Failed to load image: " << input_path_str << std::endl;
+                    release_pending();
+                    finish(input_path, done, false);
+                    return;
+                }
+                
+                // One count per write in flight, plus one held until this task
+                // is done with the file, so `done` runs after the last output
+                auto remaining = std::make_shared<std::atomic<int>>(1);
+                auto ok = std::make_shared<std::atomic<bool>>(true);
+                auto finish_one = [this, input_path, done, remaining, ok]() {
+                    if (--*remaining == 0) finish(input_path, done, ok->load());
+                };
+                
+                for (Target* target : file_targets) {
+                    if (cancelled()) {
+                        *ok = false;
+                        break;
+                    }
+                    
+                    // Process and encode into recycled buffers
+                    std::vector<uint8_t> encoded = engine.buffers().acquire();
+                    std::vector<std::vector<uint8_t>> proxies;
+                    for (size_t i = 0; i < target->options.proxy_scales.size(); ++i) {
+                        proxies.push_back(engine.buffers().acquire());
+                    }
+                    TrimRect trim;
+                    const bool reporting = target->options.report &&
+                                           target->options.function != ProcessFunction::CONVERT_TO_PNG;
+                    ImageStats stats;
+                    if (!ImageProcessor::transcode(input_image, target->options, encoded, &trim,
+                                                   reporting ? &stats : nullptr, &proxies)) {
+                        *ok = false;
+                        engine.buffers().release(std::move(encoded));
+                        for (auto& proxy : proxies) engine.buffers().release(std::move(proxy));
+                        continue;
+                    }
+                    std::string report_fields = reporting ? format_report(input_image, stats) : std::string();
+                    
+                    for (size_t i = 0; i < proxies.size(); ++i) {
+                        fs::path proxy_path = proxy_path_for(input_path, target->output_dir, target->options.output_format,
+                                                             target->options.proxy_scales[i]);
+                        if (proxies[i].empty()) {
+                            std::cerr << "Failed to create proxy: " << to_utf8(proxy_path) << std::endl;
+                            *ok = false;
+                            engine.buffers().release(std::move(proxies[i]));
+                            continue;
+                        }
+                        ++*remaining;
+                        const std::string proxy_hash = journal ? BatchJournal::hash_hex(proxies[i].data(), proxies[i].size())
+                                                               : std::string();
+                        const int64_t write_start = trace_start();
+                        engine.io().write_file(to_utf8(proxy_path), std::move(proxies[i]),
+                                               [this, proxy_path, proxy_hash, finish_one, ok, write_start](bool written, std::vector<uint8_t>&& buffer) {
+                            trace_wait("write", write_start, proxy_path);
+                            if (!written) {
+                                std::cerr << "Failed to write file: " << to_utf8(proxy_path) << std::endl;
+                                *ok = false;
+                            } else if (journal) {
+                                journal->record(to_utf8(proxy_path), buffer.size(), proxy_hash);
+                            }
+                            engine.buffers().release(std::move(buffer));
+                            engine.pool().enqueue(finish_one);
+                        }, target->options.drop_cache);
+                    }
+                    
+                    ++*remaining;
+                    fs::path output_path = output_path_for(input_path, target->output_dir, target->options.output_format);
+                    std::string output_path_str = to_utf8(output_path);
+                    const std::string hash = journal ? BatchJournal::hash_hex(encoded.data(), encoded.size()) : std::string();
+                    const int64_t write_start = trace_start();
+                    engine.io().write_file(output_path_str, std::move(encoded),
+                                           [this, target, output_path, output_path_str, hash, trim, report_fields = std::move(report_fields), finish_one, ok, write_start](bool written, std::vector<uint8_t>&& buffer) {
+                        trace_wait("write", write_start, output_path);
+                        if (written && journal) journal->record(output_path_str, buffer.size(), hash);
+                        engine.buffers().release(std::move(buffer));
+                        if (!written) {
+                            std::cerr << "Failed to write file: " << output_path_str << std::endl;
+                            *ok = false;
+                            engine.pool().enqueue(finish_one);
+                            return;
+                        }
+                        // The CSV lines are flushed one by one and `done` may touch a
+                        // network share: both run on a worker, not the I/O thread
+                        engine.pool().enqueue([target, output_path, trim, report_fields, finish_one]() {
+                            const std::string name = to_utf8(output_path.filename());
+                            if (trim.width > 0) {
+                                target->trim_manifest.append(name, std::to_string(trim.x) + ',' + std::to_string(trim.y) + ',' +
+                                                                   std::to_string(trim.width) + ',' + std::to_string(trim.height) + ',' +
+                                                                   std::to_string(trim.canvas_width) + ',' + std::to_string(trim.canvas_height));
+                            }
+                            if (!report_fields.empty()) target->report.append(name, report_fields);
+                            finish_one();
+                        });
+                    }, target->options.drop_cache);
+                }
+                
+                input_image = ImageData{};
+                release_pending();
+                finish_one();
+            });
+        }, options.drop_cache);
+    }
+    
+    // Tracing helpers (no-ops without options.tracer). Intervals spent
+    // waiting for a worker or for I/O go on async tracks.
+    int64_t trace_start() const {
+        return options.tracer ? Tracer::now_ns() : 0;
+    }
+    
+    std::string trace_name(const fs::path& path) const {
+        return options.tracer ? to_utf8(path.filename()) : std::string();
+    }
+    
+    void trace_wait(const char* name, int64_t start_ns, const fs::path& path) {
+        if (options.tracer) options.tracer->async_span(name, start_ns, Tracer::now_ns(), to_utf8(path.filename()));
+    }
+    
+    // Report columns after the name, from the kernel's statistics
+    static std::string format_report(const ImageData& image, const ImageStats& stats) {
+        const double pixels = static_cast<double>(image.width) * image.height;
+        double luma_total = 0.0;
+        for (int i = 0; i < 256; ++i) luma_total += static_cast<double>(i) * stats.luma_histogram[i];
+        
+        std::ostringstream fields;
+        fields << image.width << ',' << image.height << ',' << stats.threshold << std::fixed << std::setprecision(4)
+               << ',' << stats.alpha_sum / (255.0 * pixels)
+               << ',' << stats.visible_pixels / pixels
+               << ',' << std::setprecision(2) << luma_total / pixels;
+        return fields.str();
+    }
+    
+    void release_pending() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            --pending;
+        }
+        state_condition.notify_all();
+    }
+    
+    void finish(const fs::path& input_path, const DoneCallback& done, bool ok) {
+        if (done) done(input_path, ok);
+        engine.note_file_done();
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            --outstanding;
+        }
+        state_condition.notify_all();
+    }
+    
+    const ImageProcessor::BatchOptions& options;
+    BatchEngine& engine;
+    BatchJournal* journal;  // Null unless the batch keeps a journal
+    std::vector<std::unique_ptr<Target>> targets;  // Main output first
+    
+    int pending = 0;      // Read but not yet processed
+    int outstanding = 0;  // Submitted but not finished
+    std::mutex state_mutex;
+    std::condition_variable state_condition;
+};
+
+// Create the output directory of every target (main output first); false
+// if one cannot be used or two targets would write the same files
+static bool prepare_output_dirs(const ImageProcessor::BatchOptions& options, std::vector<fs::path>& dirs) {
+    std::vector<ImageProcessor::OutputTarget> all = options.extra_targets;
+    all.insert(all.begin(), options.main_target());
+    
+    dirs.clear();
+    for (size_t i = 0; i < all.size(); ++i) {
+        fs::path dir(reinterpret_cast<const char8_t*>(all[i].output_dir.c_str()));
+        std::error_code ec;
+        if (!fs::exists(dir, ec)) {
+            fs::create_directories(dir, ec);
+        }
+        if (all[i].output_dir.empty() || !fs::is_directory(dir, ec)) {
+            std::cerr << "Cannot use output directory: " << all[i].output_dir << std::endl;
+            return false;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (all[j].output_format == all[i].output_format && fs::equivalent(dirs[j], dir, ec)) {
+                std::cerr << "Output targets write the same files: " << all[i].output_dir << std::endl;
+                return false;
+            }
+        }
+        dirs.push_back(dir);
+    }
+    return true;
+}
+
 bool ImageProcessor::batch_process(const BatchOptions& options) {
+    BatchEngine engine(options.num_threads, options.io_queue_depth, options.pin_threads);
+    return batch_process(options, engine);
+}
+
+bool ImageProcessor::batch_process(const BatchOptions& options, BatchEngine& engine) {
     fs::path input_dir(reinterpret_cast<const char8_t*>(options.input_dir.c_str()));
-    fs::path output_dir(reinterpret_cast<const char8_t*>(options.output_dir.c_str()));
 
     if (!fs::exists(input_dir) || !fs::is_directory(input_dir)) {
         std::cerr << "Input directory does not exist: " << options.input_dir << std::endl;
         return false;
     }
     
-    // Create output directory if it doesn't exist
-    if (!fs::exists(output_dir)) {
-        fs::create_directories(output_dir);
+    // Create output directories if they don't exist
+    std::vector<fs::path> output_dirs;
+    if (!prepare_output_dirs(options, output_dirs)) {
+        return false;
     }
     
     // Collect all valid image files
@@ -369,11 +1440,7 @@ bool ImageProcessor::batch_process(const BatchOptions& options) {
     for (const auto& entry : fs::directory_iterator(input_dir)) {
         if (!entry.is_regular_file()) continue;
         
-        // fs::path -> u8string -> std::string (UTF-8)
-        std::u8string u8path = entry.path().u8string();
-        std::string path_str(reinterpret_cast<const char*>(u8path.c_str()));
-
-        ImageFormat fmt = detect_format(path_str);
+        ImageFormat fmt = detect_format(to_utf8(entry.path()));
         if (fmt != ImageFormat::UNKNOWN) {
             image_files.push_back(entry.path());
         }
@@ -384,69 +1451,282 @@ bool ImageProcessor::batch_process(const BatchOptions& options) {
         return false;
     }
     
-    // Determine thread count
-    int num_threads = options.num_threads;
-    if (num_threads <= 0) {
-        num_threads = static_cast<int>(std::thread::hardware_concurrency());
-        if (num_threads <= 0) num_threads = 4;
+    // Keep only this shard's files; the order is made deterministic so that
+    // cooperating processes walk the input in the same sequence
+    ShardSpec shard{options.shard_index, options.shard_count};
+    std::erase_if(image_files, [&](const fs::path& p) {
+        return !shard.contains(to_utf8(p.filename()));
+    });
+    std::sort(image_files.begin(), image_files.end());
+    
+    if (image_files.empty()) {
+        std::cout << "No files assigned to shard " << shard.index << "/" << shard.count << std::endl;
+        return true;
     }
     
-    // Create thread pool
-    ThreadPool pool(num_threads);
+    std::unique_ptr<ClaimDirectory> claims;
+    if (!options.claim_dir.empty()) {
+        claims = std::make_unique<ClaimDirectory>(options.claim_dir);
+        if (!claims->is_valid()) {
+            std::cerr << "Cannot use claim directory: " << options.claim_dir << std::endl;
+            return false;
+        }
+    }
     
-    std::atomic<int> completed{0};
-    const int total = static_cast<int>(image_files.size());
-    
-    // Process each file
-    for (const auto& input_path : image_files) {
-        pool.enqueue([&, input_path]() {
-            // Load image
-            std::u8string u8_input_path = input_path.u8string();
-            std::string input_path_str(reinterpret_cast<const char*>(u8_input_path.c_str()));
-            ImageData input_image = load_image(input_path_str);
-            if (!input_image.is_valid()) {
-                completed++;
-                if (options.progress_callback) {
-                    options.progress_callback(completed, total, input_path.filename().string());
-                }
-                return;
+    // Checkpoint journal in the main output directory
+    std::unique_ptr<BatchJournal> journal;
+    if (options.journal || options.resume) {
+        const std::string journal_path = to_utf8(output_dirs.front() / JOURNAL_NAME);
+        journal = std::make_unique<BatchJournal>();
+        if (!journal->open(journal_path, options.resume)) {
+            std::cerr << "Cannot open journal: " << journal_path << std::endl;
+            return false;
+        }
+    }
+    
+    FilePipeline pipeline(options, output_dirs.front(), engine, journal.get());
+    
+    // Inputs an earlier run finished count as done up front
+    int resumed = 0;
+    if (options.resume) {
+        resumed = static_cast<int>(std::erase_if(image_files, [&](const fs::path& p) {
+            return pipeline.journaled(p);
+        }));
+        std::cout << "Resuming: " << resumed << " of " << resumed + image_files.size()
+                  << " files already done" << std::endl;
+    }
+    
+    std::atomic<int> completed{resumed};
+    const int total = static_cast<int>(image_files.size()) + resumed;
+    if (options.progress) {
+        options.progress->total.fetch_add(total, std::memory_order_relaxed);
+        options.progress->completed.fetch_add(resumed, std::memory_order_relaxed);
+    }
+    
+    auto report_done = [&](const fs::path& input_path, bool) {
+        int done = ++completed;
+        if (options.progress) options.progress->completed.fetch_add(1, std::memory_order_relaxed);
+        if (options.progress_callback) {
+            options.progress_callback(done, total, input_path.filename().string());
+        }
+    };
+    
+    // With a claim directory a finished file leaves a done marker and a
+    // failed one gives its claim back
+    auto settle_claim = [&](const fs::path& input_path, bool ok) {
+        const std::string key = to_utf8(input_path.filename());
+        if (ok) {
+            claims->complete(key);
+        } else {
+            claims->release(key);
+        }
+        report_done(input_path, ok);
+    };
+    
+    // Process each file. submit() blocks while the workers are busy, so the
+    // kernel is asked to start reading the next few files in the meantime;
+    // the look-ahead follows the worker count. (Not with a claim directory:
+    // most of those files will be taken by other processes.)
+    size_t prefetched = 0;  // image_files[0, prefetched) have been hinted
+    bool claims_ok = true;
+    for (size_t i = 0; i < image_files.size(); ++i) {
+        const fs::path& input_path = image_files[i];
+        if (pipeline.cancelled()) break;
+        
+        if (!claims) {
+            const size_t horizon = std::min(image_files.size(), i + 1 + 2 * static_cast<size_t>(engine.thread_count()));
+            for (prefetched = std::max(prefetched, i + 1); prefetched < horizon; ++prefetched) {
+                AsyncFileIO::prefetch(to_utf8(image_files[prefetched]));
             }
-            
-            // Process image
-            ImageData output_image;
-            if (options.function == ProcessFunction::LUMA_TO_ALPHA) {
-                output_image = luma_to_alpha(input_image, options.luma_threshold);
-            } else if (options.function == ProcessFunction::LUMA_TO_ALPHA_CUSTOM) {
-                output_image = luma_to_alpha_custom(input_image, options.custom_params);
-            } else {
-                output_image = process(input_image, options.function);
+        }
+        
+        if (claims) {
+            const ClaimDirectory::Result claim = claims->try_claim(to_utf8(input_path.filename()));
+            if (claim == ClaimDirectory::Result::FAILED) {
+                claims_ok = false;
+                break;
             }
-            if (!output_image.is_valid()) {
-                completed++;
-                if (options.progress_callback) {
-                    options.progress_callback(completed, total, input_path.filename().string());
+            // Another process took or already finished this file
+            if (claim == ClaimDirectory::Result::TAKEN) {
+                report_done(input_path, true);
+                continue;
+            }
+            pipeline.submit(input_path, settle_claim);
+            continue;
+        }
+        
+        pipeline.submit(input_path, report_done);
+    }
+    
+    pipeline.wait();
+    
+    return claims_ok && !pipeline.cancelled();
+}
+
+bool ImageProcessor::batch_process_jobs(const std::vector<BatchOptions>& jobs, BatchEngine& engine,
+                                        const std::function<void(size_t, bool)>& job_done) {
+    std::atomic<size_t> next_job{0};
+    std::atomic<bool> all_ok{true};
+    
+    // Each feeder takes the next job as soon as it has submitted and waited
+    // out its current one; with two feeders the pool's queue always holds
+    // files of the next job while the previous job drains
+    auto feed = [&]() {
+        for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+            const BatchOptions& job = jobs[i];
+            const bool cancelled = job.cancel_flag && job.cancel_flag->load();
+            const bool ok = !cancelled && batch_process(job, engine);
+            if (!ok) all_ok = false;
+            if (job_done) job_done(i, ok);
+        }
+    };
+    
+    std::vector<std::thread> feeders;
+    for (size_t i = 1; i < std::min(jobs.size(), JOB_OVERLAP); ++i) {
+        feeders.emplace_back(feed);
+    }
+    feed();
+    for (auto& feeder : feeders) feeder.join();
+    
+    return all_ok;
+}
+
+bool ImageProcessor::batch_process_memory(const BatchOptions& options, const MemorySource& source,
+                                          const MemorySink& sink) {
+    BatchEngine engine(options.num_threads, options.io_queue_depth, options.pin_threads);
+    return batch_process_memory(options, engine, source, sink);
+}
+
+bool ImageProcessor::batch_process_memory(const BatchOptions& options, BatchEngine& engine,
+                                          const MemorySource& source, const MemorySink& sink) {
+    // Only the main output applies
+    BatchOptions item_options = options;
+    item_options.extra_targets.clear();
+    
+    auto cancelled = [&] { return options.cancel_flag && options.cancel_flag->load(); };
+    
+    // Same bound as FilePipeline: items pulled but not yet processed
+    std::mutex state_mutex;
+    std::condition_variable state_condition;
+    int pending = 0;
+    
+    MemoryItem item;
+    while (!cancelled() && source(item)) {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            state_condition.wait(lock, [&] { return pending < engine.thread_count() * 4; });
+            ++pending;
+        }
+        if (options.progress) options.progress->total.fetch_add(1, std::memory_order_relaxed);
+        
+        const int64_t queued_at = options.tracer ? Tracer::now_ns() : 0;
+        engine.pool().enqueue([&, queued_at, item = std::move(item)]() mutable {
+            if (options.tracer) options.tracer->async_span("queue", queued_at, Tracer::now_ns(), item.name);
+            MemoryResult result;
+            result.name = std::move(item.name);
+            if (!cancelled()) {
+                TraceSpan span(options.tracer, "process", result.name);
+                
+                // PNG -> PNG: hand the input back instead of decoding and re-encoding
+                if (item_options.function == ProcessFunction::CONVERT_TO_PNG && !item_options.force_reencode &&
+                    item_options.output_format == OutputFormat::PNG &&
+                    is_passthrough_png(item.encoded.data(), item.encoded.size())) {
+                    result.encoded = std::move(item.encoded);
+                    result.ok = true;
+                } else {
+                    ImageData input_image = std::move(item.pixels);
+                    if (!item.encoded.empty()) {
+                        TraceSpan decode_span(options.tracer, "decode");
+                        input_image = decode_image(item.encoded.data(), item.encoded.size());
+                        std::vector<uint8_t>().swap(item.encoded);
+                    }
+                    result.encoded = engine.buffers().acquire();
+                    result.ok = input_image.is_valid() &&
+                                transcode(input_image, item_options, result.encoded, &result.trim);
+                    if (!result.ok) std::cerr << "Failed to process item: " << result.name << std::endl;
                 }
-                return;
             }
+            sink(std::move(result));
+            if (options.progress) options.progress->completed.fetch_add(1, std::memory_order_relaxed);
             
-            // Save as PNG
-            fs::path output_path = output_dir / input_path.filename();
-            output_path.replace_extension(".png");
-            
-            std::u8string u8_output_path = output_path.u8string();
-            std::string output_path_str(reinterpret_cast<const char*>(u8_output_path.c_str()));
-            save_png(output_path_str, output_image);
-            
-            completed++;
-            if (options.progress_callback) {
-                options.progress_callback(completed, total, input_path.filename().string());
-            }
+            // Notify under the lock: once pending reaches 0 the caller may
+            // return and destroy the condition variable
+            std::lock_guard<std::mutex> lock(state_mutex);
+            --pending;
+            state_condition.notify_all();
         });
+        item = MemoryItem{};
+    }
+    
+    std::unique_lock<std::mutex> lock(state_mutex);
+    state_condition.wait(lock, [&] { return pending == 0; });
+    return !cancelled();
+}
+
+bool ImageProcessor::watch_folder(const BatchOptions& options, const std::atomic<bool>& stop_flag,
+                                  int settle_ms) {
+    fs::path input_dir(reinterpret_cast<const char8_t*>(options.input_dir.c_str()));
+    
+    if (!FolderWatcher::is_supported()) {
+        std::cerr << "Watch mode is only supported on Linux" << std::endl;
+        return false;
     }
+    if (!fs::exists(input_dir) || !fs::is_directory(input_dir)) {
+        std::cerr << "Input directory does not exist: " << options.input_dir << std::endl;
+        return false;
+    }
+    std::vector<fs::path> output_dirs;
+    if (!prepare_output_dirs(options, output_dirs)) {
+        return false;
+    }
+    // Outputs written into the watched folder would be picked up again
+    for (const fs::path& output_dir : output_dirs) {
+        if (fs::equivalent(input_dir, output_dir)) {
+            std::cerr << "Output directory must differ from the watched directory" << std::endl;
+            return false;
+        }
+    }
+    
+    FolderWatcher watcher(settle_ms);
+    if (!watcher.open(options.input_dir)) {
+        std::cerr << "Failed to watch directory: " << options.input_dir << std::endl;
+        return false;
+    }
+    
+    // The pool stays warm for the whole session
+    BatchEngine engine(options.num_threads, options.io_queue_depth, options.pin_threads);
+    FilePipeline pipeline(options, output_dirs.front(), engine);
+    ShardSpec shard{options.shard_index, options.shard_count};
+    
+    std::atomic<int> completed{0};
+    std::atomic<int> seen{0};
+    auto report_done = [&](const fs::path& input_path, bool) {
+        int done = ++completed;
+        if (options.progress) options.progress->completed.fetch_add(1, std::memory_order_relaxed);
+        if (options.progress_callback) {
+            options.progress_callback(done, seen, input_path.filename().string());
+        }
+    };
     
-    // Wait for all tasks to complete
-    pool.wait();
+    while (!stop_flag) {
+        for (const std::string& name : watcher.poll(200)) {
+            fs::path input_path = input_dir / fs::path(reinterpret_cast<const char8_t*>(name.c_str()));
+            if (detect_format(name) == ImageFormat::UNKNOWN || !shard.contains(name)) {
+                watcher.done(name);
+                continue;
+            }
+            
+            ++seen;
+            if (options.progress) options.progress->total.fetch_add(1, std::memory_order_relaxed);
+            // A file rewritten while this job runs is reported again afterwards
+            pipeline.submit(input_path, [&, name](const fs::path& path, bool ok) {
+                report_done(path, ok);
+                watcher.done(name);
+            });
+        }
+    }
     
+    pipeline.wait();
     return true;
 }
 
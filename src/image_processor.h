@@ -1,17 +1,31 @@
 ﻿#pragma once
 
+#include "image_data.h"
+#include "resize.h"
+
+#include <array>
 #include <string>
 #include <vector>
 #include <cstdint>
 #include <functional>
+#include <atomic>
 
 namespace fbiu {
 
+class BatchEngine;
+class Tracer;
+struct BatchProgress;
+
 // ITU-R BT.601 standard luminance coefficients
 constexpr float LUMA_COEF_R = 0.299f;
 constexpr float LUMA_COEF_G = 0.587f;
 constexpr float LUMA_COEF_B = 0.114f;
 
+// ITU-R BT.709 (HDTV / sRGB primaries) luminance coefficients
+constexpr float LUMA709_COEF_R = 0.2126f;
+constexpr float LUMA709_COEF_G = 0.7152f;
+constexpr float LUMA709_COEF_B = 0.0722f;
+
 // Default threshold for luma-to-alpha conversion
 constexpr uint8_t DEFAULT_LUMA_THRESHOLD = 200;
 
@@ -21,6 +35,9 @@ struct CustomLumaParams {
     float coef_g = LUMA_COEF_G;
     float coef_b = LUMA_COEF_B;
     uint8_t threshold = DEFAULT_LUMA_THRESHOLD;
+    // Decode the sRGB-encoded channels to linear light before weighting them;
+    // luminance and threshold are then linear Y scaled to 0-255
+    bool linear = false;
 };
 
 enum class ImageFormat {
@@ -29,25 +46,71 @@ enum class ImageFormat {
     TGA,
     JPEG,
     BMP,
+    QOI,
+    RAW,      // Uncompressed .fbraw (see raw_format.h)
     UNKNOWN
 };
 
+// Encoding of batch outputs
+enum class OutputFormat {
+    PNG,
+    QOI,      // Fast lossless, 3/4 channels
+    RAW       // Uncompressed, page-aligned pixel rows (.fbraw)
+};
+
 enum class ProcessFunction {
     LUMA_TO_ALPHA,        // Luminance → Transparency (alpha) mask
     LUMA_TO_ALPHA_CUSTOM, // Custom luminance → Transparency with adjustable parameters
     CONVERT_TO_PNG        // Simple format conversion to PNG
 };
 
-struct ImageData {
-    std::vector<uint8_t> pixels;
+// Properties of a processed image gathered during the kernel pass, so the
+// PNG writer can pick a smaller layout without another scan of the pixels.
+// Default-constructed stats mean "unknown" and keep the RGBA layout.
+struct ImageStats {
+    bool grayscale = false;        // R == G == B for every pixel
+    bool opaque = false;           // Alpha == 255 for every pixel
+    bool fits_palette = false;     // At most 256 distinct RGBA values...
+    std::vector<uint32_t> colors;  // ...listed here (R | G << 8 | B << 16 | A << 24)
+
+    // Bounding box of the pixels with alpha > 0 (bounds_width == 0: none)
+    int bounds_x = 0;
+    int bounds_y = 0;
+    int bounds_width = 0;
+    int bounds_height = 0;
+
+    // Luminance of the source and coverage of the output
+    std::array<uint32_t, 256> luma_histogram{};
+    uint64_t alpha_sum = 0;       // Sum of output alpha (coverage = alpha_sum / (255 * pixels))
+    uint64_t visible_pixels = 0;  // Output pixels with alpha > 0
+    int threshold = -1;           // Threshold the kernel used (-1: unknown)
+};
+
+// Per-file statistics written with BatchOptions::report, one line per file
+// (name,width,height,threshold,alpha_coverage,visible_fraction,luma_mean)
+// appended to this CSV in the output directory
+constexpr const char* REPORT_NAME = "report.csv";
+
+// With BatchOptions::trim, each output holds only the bounding box of its
+// visible pixels. PNG outputs carry the offset in an oFFs chunk, and one line
+// per file (name,x,y,width,height,canvas_width,canvas_height) is appended to
+// this CSV in the output directory; a later line for the same name wins.
+constexpr const char* TRIM_MANIFEST_NAME = "trim_manifest.csv";
+
+// With BatchOptions::journal, every output written completely is recorded in
+// this file in the main output directory (format in journal.h). A resumed
+// batch skips the inputs whose outputs are all recorded and still intact,
+// and redoes the rest, overwriting any partially written files.
+constexpr const char* JOURNAL_NAME = "fbiu_journal.log";
+
+// Placement of a trimmed output inside the original image
+struct TrimRect {
+    int x = 0;
+    int y = 0;
     int width = 0;
     int height = 0;
-    int channels = 0;
-    
-    bool is_valid() const {
-        return width > 0 && height > 0 && channels > 0 && 
-               pixels.size() == static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels);
-    }
+    int canvas_width = 0;
+    int canvas_height = 0;
 };
 
 class ImageProcessor {
@@ -57,41 +120,207 @@ class ImageProcessor {
 
     // Load image from file
     static ImageData load_image(const std::string& path);
+
+    // Load an image for display in a max_width x max_height box. JPEGs are
+    // decoded at 1/2, 1/4 or 1/8 size in the DCT domain when that still
+    // covers the box; other files are returned at full size.
+    static ImageData load_image_scaled(const std::string& path, int max_width, int max_height);
+    
+    // Decode an image already read into memory
+    static ImageData decode_image(const uint8_t* data, size_t size);
     
     // Save image as PNG
     static bool save_png(const std::string& path, const ImageData& image);
     
+    // Encode image as PNG into memory (replaces the contents of `out`).
+    // With stats, writes an indexed PNG (<= 256 colours), gray+alpha or gray
+    // when that represents the pixels exactly.
+    static bool encode_png(const ImageData& image, std::vector<uint8_t>& out,
+                           const ImageStats* stats = nullptr);
+    
+    // Encode image in the given output format (replaces the contents of `out`)
+    static bool encode_image(const ImageData& image, OutputFormat format, std::vector<uint8_t>& out,
+                             const ImageStats* stats = nullptr);
+    
+    // File extension (".png", ".qoi", ".fbraw") and option name ("png", "qoi", "raw")
+    static const char* output_extension(OutputFormat format);
+    static const char* output_format_name(OutputFormat format);
+    static bool parse_output_format(const std::string& name, OutputFormat& out);
+    
+    // Function names used by the CLI and the server ("luma2alpha", "luma2alpha_custom", "png")
+    static const char* function_name(ProcessFunction function);
+    static bool parse_function(const std::string& name, ProcessFunction& out);
+    
+    // Luminance weights as given to the CLI: "bt601", "bt709" or "R,G,B"
+    // (sets the coefficients of `params`)
+    static bool parse_luma_weights(const std::string& text, CustomLumaParams& params);
+    
+    // Proxy scales as given to the CLI and the server: comma-separated
+    // divisors of 2-64 ("2,4" = half and quarter size)
+    static bool parse_proxy_scales(const std::string& list, std::vector<int>& out);
+    
     // Detect image format from file extension
     static ImageFormat detect_format(const std::string& path);
     
-    // Process functions
-    static ImageData luma_to_alpha(const ImageData& input, uint8_t threshold = DEFAULT_LUMA_THRESHOLD);
-    static ImageData luma_to_alpha_custom(const ImageData& input, const CustomLumaParams& params);
+    // True if `header` (at least the first 33 bytes of a file) is a PNG that
+    // CONVERT_TO_PNG may copy unchanged: valid signature and IHDR, <= 8 bits
+    // per sample (16-bit sources are reduced to 8 bits by re-encoding)
+    static bool is_passthrough_png(const uint8_t* header, size_t size);
+    
+    // Process functions (stats, when given, is filled during the pixel loop)
+    static ImageData luma_to_alpha(const ImageData& input, uint8_t threshold = DEFAULT_LUMA_THRESHOLD,
+                                   ImageStats* stats = nullptr);
+    static ImageData luma_to_alpha_custom(const ImageData& input, const CustomLumaParams& params,
+                                          ImageStats* stats = nullptr);
     static ImageData convert_to_png(const ImageData& input);
     
+    // Otsu's method: the threshold that best splits a 256-bin luminance
+    // histogram into two classes (DEFAULT_LUMA_THRESHOLD if it has one value)
+    static uint8_t otsu_threshold(const std::array<uint32_t, 256>& histogram);
+    
     // Apply processing function
     static ImageData process(const ImageData& input, ProcessFunction func);
     
+    // One output of a batch: the function, its parameters and where to write
+    struct OutputTarget {
+        std::string output_dir;
+        ProcessFunction function = ProcessFunction::LUMA_TO_ALPHA;
+        uint8_t luma_threshold = DEFAULT_LUMA_THRESHOLD;
+        CustomLumaParams custom_params;
+        bool auto_threshold = false;
+        OutputFormat output_format = OutputFormat::PNG;
+        bool keep_rgba = false;
+        bool trim = false;
+    };
+    
+    // Target specs are comma-separated key=value pairs:
+    //   output=<dir>,function=<name>,threshold=<0-255|auto>,coef_r=<f>,coef_g=<f>,
+    //   coef_b=<f>,weights=<bt601|bt709>,linear=<0|1>,output_format=<png|qoi|raw>,
+    //   keep_rgba=<0|1>,trim=<0|1>
+    // parse_target_spec() changes only the keys present in `spec` (values
+    // cannot contain commas); format_target_spec() writes every key.
+    static bool parse_target_spec(const std::string& spec, OutputTarget& target);
+    static std::string format_target_spec(const OutputTarget& target);
+    
     // Batch processing
     struct BatchOptions {
         std::string input_dir;
         std::string output_dir;
         ProcessFunction function = ProcessFunction::LUMA_TO_ALPHA;
-        int num_threads = 0;  // 0 = auto-detect
+        int num_threads = 0;  // 0 = auto-detect, ADAPTIVE_THREADS = tune while running (batch_engine.h)
+        int io_queue_depth = 0;  // Files kept in flight by the async I/O backend (0 = default)
+        bool pin_threads = false;  // Pin workers to cores spread over the NUMA nodes (Linux, see BatchEngine)
         uint8_t luma_threshold = DEFAULT_LUMA_THRESHOLD;  // Threshold for standard luma_to_alpha
         CustomLumaParams custom_params;  // Parameters for LUMA_TO_ALPHA_CUSTOM
-        std::function<void(int, int, const std::string&)> progress_callback;
+        bool auto_threshold = false;  // Luma functions: pick the threshold per image (otsu_threshold)
+        int shard_index = 0;  // Process only files whose name hash falls in shard_index of shard_count
+        int shard_count = 1;
+        std::string claim_dir;  // Shared claim directory for multi-process work splitting (empty = off)
+        std::function<void(int, int, const std::string&)> progress_callback;  // Called per file from the workers
+        BatchProgress* progress = nullptr;  // Counters to sample instead of a callback (see progress.h)
+        const std::atomic<bool>* cancel_flag = nullptr;  // Set to stop the batch early
+        Tracer* tracer = nullptr;  // Record read/decode/kernel/encode/write spans (see trace.h)
+        bool force_reencode = false;  // CONVERT_TO_PNG: decode/encode even PNG sources
+        OutputFormat output_format = OutputFormat::PNG;
+        bool keep_rgba = false;  // Always write RGBA PNGs (no gray / indexed layouts)
+        bool trim = false;  // Luma functions: crop outputs to their visible pixels (see TRIM_MANIFEST_NAME)
+        bool report = false;  // Luma functions: write per-file statistics (see REPORT_NAME)
+        bool drop_cache = false;  // Evict inputs and outputs from the page cache once done
+        bool journal = false;  // Record finished outputs in JOURNAL_NAME (batch_process only)
+        bool resume = false;  // Skip inputs an earlier journaled run finished (implies journal)
+        
+        // Downscaled copies of every output, resized from the processed pixels
+        // before they are encoded: for each N, <stem>_proxy<N> at 1/N of the
+        // output's size (rounded up) next to it, in the same output format.
+        // Proxies of trimmed outputs are scaled from the trimmed image and
+        // carry no offset.
+        std::vector<int> proxy_scales;
+        ResizeFilter proxy_filter = ResizeFilter::BOX;
+        
+        // Further outputs rendered from the same read and decode of each input
+        // (the fields above describe the first output)
+        std::vector<OutputTarget> extra_targets;
+        
+        // The first output as a target (a starting point for extra_targets)
+        OutputTarget main_target() const;
+        // Replace the first output's settings with `target`
+        void set_main_target(const OutputTarget& target);
     };
     
     static bool batch_process(const BatchOptions& options);
     
+    // Run a batch on a long-lived engine shared with other batches
+    // (num_threads / io_queue_depth / pin_threads are taken from the engine)
+    static bool batch_process(const BatchOptions& options, BatchEngine& engine);
+    
+    // Job lists: run independent batches back to back on one engine. Up to
+    // JOB_OVERLAP jobs feed the pool at once, so while one job waits for its
+    // last files the workers already take the first files of the next one.
+    // `job_done` (optional) receives each job's index and result, possibly
+    // from two threads at once. Returns true if every job succeeded.
+    static constexpr size_t JOB_OVERLAP = 2;
+    static bool batch_process_jobs(const std::vector<BatchOptions>& jobs, BatchEngine& engine,
+                                   const std::function<void(size_t, bool)>& job_done = nullptr);
+    
+    // Read a CSV job list. The header row names the columns: input plus any
+    // target spec key (output, function, threshold, coef_r, ...); each later
+    // row is one job starting from `defaults`, with empty cells keeping the
+    // default. input and output are required. Blank lines and lines
+    // starting with '#' are skipped; values cannot contain commas.
+    static bool load_job_list(const std::string& path, const BatchOptions& defaults,
+                              std::vector<BatchOptions>& jobs);
+    
+    // In-memory batches for host applications: no file is read or written.
+    // Items are pulled from `source` on the calling thread until it returns
+    // false; each one is decoded (or its pixels used as they are), processed
+    // with the main output's settings (function and parameters,
+    // output_format, keep_rgba, trim) on the worker pool, and handed to
+    // `sink`. The sink runs on the workers, possibly concurrently, in
+    // completion order. Directories, extra_targets, report, sharding,
+    // proxies, journal and drop_cache do not apply; progress, cancel_flag and
+    // tracer do.
+    struct MemoryItem {
+        std::string name;               // Returned with the result (e.g. a frame id)
+        std::vector<uint8_t> encoded;   // Encoded image in any supported format, or...
+        ImageData pixels;               // ...already decoded pixels (used when `encoded` is empty)
+    };
+    struct MemoryResult {
+        std::string name;
+        bool ok = false;
+        std::vector<uint8_t> encoded;   // Output in options.output_format
+        TrimRect trim;                  // With options.trim: the kept region
+    };
+    using MemorySource = std::function<bool(MemoryItem& item)>;
+    using MemorySink = std::function<void(MemoryResult&& result)>;
+    
+    // Returns false if the batch was cancelled; per-item failures are
+    // reported to the sink with ok == false
+    static bool batch_process_memory(const BatchOptions& options, const MemorySource& source, const MemorySink& sink);
+    static bool batch_process_memory(const BatchOptions& options, BatchEngine& engine,
+                                     const MemorySource& source, const MemorySink& sink);
+    
+    // Watch mode: process files that appear (or are rewritten) in input_dir
+    // until stop_flag is set. Files are handled once their writer has closed
+    // them and they have been quiet for settle_ms. Linux only (inotify).
+    static bool watch_folder(const BatchOptions& options, const std::atomic<bool>& stop_flag,
+                             int settle_ms = 500);
+    
+    // Apply options.function (with its parameters) to one image; kernels that
+    // support it fill `stats`
+    static ImageData apply_function(const ImageData& input, const BatchOptions& options,
+                                    ImageStats* stats = nullptr);
+    
 private:
-    // Luminance calculation: L = 0.299*R + 0.587*G + 0.114*B
-    static uint8_t calculate_luminance(uint8_t r, uint8_t g, uint8_t b);
+    friend class FilePipeline;
     
-    // Custom luminance calculation with custom coefficients
-    static uint8_t calculate_luminance_custom(uint8_t r, uint8_t g, uint8_t b, 
-                                             float coef_r, float coef_g, float coef_b);
+    // Apply options.function to a decoded image and encode the result into
+    // `encoded` in options.output_format. With options.trim, `trim` receives
+    // the kept region; `stats`, when given, is filled by the kernel. With
+    // `proxies` (one buffer per options.proxy_scales entry), each buffer
+    // receives that proxy encoded, or is left empty if it failed.
+    static bool transcode(const ImageData& input, const BatchOptions& options, std::vector<uint8_t>& encoded,
+                          TrimRect* trim = nullptr, ImageStats* stats = nullptr,
+                          std::vector<std::vector<uint8_t>>* proxies = nullptr);
 };
 
 } // namespace fbiu
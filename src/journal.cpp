@@ -0,0 +1,202 @@
+#include "journal.h"
+#include "file_io.h"
+#include "shard.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace fbiu {
+
+namespace {
+
+// Entries hold absolute paths, so a run resumed from another working
+// directory still finds them
+std::string absolute_path(const std::string& path) {
+    std::error_code ec;
+    const fs::path absolute = fs::absolute(fs::path(reinterpret_cast<const char8_t*>(path.c_str())), ec);
+    if (ec) return path;
+    const std::u8string u8path = absolute.lexically_normal().u8string();
+    return std::string(reinterpret_cast<const char*>(u8path.c_str()));
+}
+
+} // namespace
+
+BatchJournal::~BatchJournal() {
+    if (fd < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    flusher.join();
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+bool BatchJournal::open(const std::string& path, bool resume) {
+    const bool torn = resume && load(path);
+#ifdef _WIN32
+    fd = _wopen(fs::path(reinterpret_cast<const char8_t*>(path.c_str())).c_str(),
+                _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+    const long pid = _getpid();
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    const long pid = getpid();
+#endif
+    if (fd < 0) return false;
+    if (torn) write_all("\n");  // Keep the next entry off the torn line
+    // Leading newline: an earlier run may have left a torn line behind
+    if (!resume) write_all("\n# start pid=" + std::to_string(pid) + "\n");
+    flusher = std::thread(&BatchJournal::run, this);
+    return true;
+}
+
+bool BatchJournal::load(const std::string& path) {
+    std::ifstream in(fs::path(reinterpret_cast<const char8_t*>(path.c_str())), std::ios::binary);
+    if (!in) return false;
+
+    struct Entry {
+        uint64_t size;
+        std::string hash;
+        std::string path;
+    };
+    std::vector<Entry> entries;
+    std::string line;
+    bool torn = false;
+    while (std::getline(in, line)) {
+        if (in.eof()) {
+            torn = true;  // No newline: cut off by a crash
+            break;
+        }
+        if (!line.empty() && line[0] == '#') {
+            entries.clear();  // A run started afresh here
+            continue;
+        }
+        const size_t first = line.find(',');
+        const size_t second = first == std::string::npos ? first : line.find(',', first + 1);
+        if (second == std::string::npos || second + 1 == line.size()) continue;
+        Entry entry;
+        try {
+            entry.size = std::stoull(line.substr(0, first));
+        } catch (...) {
+            continue;
+        }
+        entry.hash = line.substr(first + 1, second - first - 1);
+        entry.path = line.substr(second + 1);
+        entries.push_back(std::move(entry));
+    }
+
+    // The latest entry of each output counts; it is done if the file still
+    // has the recorded size (and, near the end, the recorded bytes)
+    std::unordered_map<std::string, size_t> latest;
+    for (size_t i = 0; i < entries.size(); ++i) latest[entries[i].path] = i;
+    const size_t tail = entries.size() > VERIFY_TAIL ? entries.size() - VERIFY_TAIL : 0;
+    for (const auto& [output_path, index] : latest) {
+        const Entry& entry = entries[index];
+        std::error_code ec;
+        const uintmax_t size = fs::file_size(fs::path(reinterpret_cast<const char8_t*>(output_path.c_str())), ec);
+        if (ec || size != entry.size) continue;
+        if (index >= tail && entry.hash != "-") {
+            std::vector<uint8_t> data;
+            if (!AsyncFileIO::read_file_sync(output_path, data) || hash_hex(data.data(), data.size()) != entry.hash) {
+                continue;
+            }
+        }
+        done.insert(output_path);
+    }
+    return torn;
+}
+
+bool BatchJournal::is_done(const std::string& output_path) const {
+    return done.count(absolute_path(output_path)) > 0;
+}
+
+void BatchJournal::record(const std::string& output_path, uint64_t size, const std::string& hash) {
+    const std::string line = std::to_string(size) + ',' + hash + ',' + absolute_path(output_path) + '\n';
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) return;
+        pending += line;
+        if (++pending_count < SYNC_COUNT) return;
+    }
+    condition.notify_all();
+}
+
+std::string BatchJournal::hash_hex(const uint8_t* data, size_t size) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(stable_hash(data, size)));
+    return text;
+}
+
+void BatchJournal::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        condition.wait_for(lock, SYNC_INTERVAL, [this] { return stopping || pending_count >= SYNC_COUNT; });
+        write_pending(lock);
+    }
+    write_pending(lock);
+}
+
+void BatchJournal::write_pending(std::unique_lock<std::mutex>& lock) {
+    if (pending.empty()) return;
+    std::string batch;
+    batch.swap(pending);
+    pending_count = 0;
+    lock.unlock();
+
+    // The outputs of these lines are complete in the page cache; on Linux
+    // they are flushed first (syncfs on the journal's file system), so a
+    // synced line never points at data that a power loss could still drop
+#ifdef __linux__
+    syncfs(fd);
+#endif
+    if (!write_all(batch)) {
+        std::cerr << "Failed to write journal" << std::endl;
+    }
+#ifdef _WIN32
+    _commit(fd);
+#else
+    fsync(fd);
+#endif
+
+    lock.lock();
+}
+
+// One write per call where the system allows it, so with O_APPEND the lines
+// land whole and in one piece next to those of other writers
+bool BatchJournal::write_all(const std::string& text) {
+    const char* data = text.data();
+    size_t left = text.size();
+    while (left > 0) {
+#ifdef _WIN32
+        const int written = _write(fd, data, static_cast<unsigned>(left));
+#else
+        const ssize_t written = ::write(fd, data, left);
+#endif
+        if (written <= 0) return false;
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace fbiu
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace fbiu {
+
+// Checkpoint journal of a batch (BatchOptions::journal / resume).
+//
+// Append-only text file with one line per output file written completely:
+//   <size>,<hash>,<output path>
+// where hash is stable_hash() of the file's bytes in hex ("-" for outputs
+// copied without being encoded). Lines are buffered and written + fsynced
+// by a background thread every SYNC_COUNT entries or SYNC_INTERVAL, and
+// when the journal closes, so recording never blocks the I/O completions
+// and a crash loses at most the last unsynced batch. A torn last line is
+// ignored when the journal is read back.
+//
+// Several processes (claim-dir workers, --jobs sharing an output directory)
+// may append to the same journal: it is opened O_APPEND and every batch of
+// lines goes out in one write, so entries never overwrite or split each
+// other. A run that does not resume appends a "#" start line instead of
+// truncating; only entries after the last start line are trusted, so a
+// concurrent start can at worst make a later resume redo some files.
+class BatchJournal {
+public:
+    static constexpr size_t SYNC_COUNT = 64;
+    static constexpr std::chrono::milliseconds SYNC_INTERVAL{1000};
+
+    // Entries at the end of a resumed journal whose outputs are read back and
+    // hashed; their data may not have reached the disk before a crash even
+    // though the line did. Earlier entries are checked by size only.
+    static constexpr size_t VERIFY_TAIL = 2 * SYNC_COUNT;
+
+    BatchJournal() = default;
+    ~BatchJournal();
+
+    BatchJournal(const BatchJournal&) = delete;
+    BatchJournal& operator=(const BatchJournal&) = delete;
+
+    // Open `path` for appending. With `resume`, existing entries are loaded
+    // and verified against the files on disk; otherwise a start line makes
+    // the journal count as empty. False if the file cannot be opened.
+    bool open(const std::string& path, bool resume);
+
+    // True if a resumed entry for `output_path` matched the file on disk
+    bool is_done(const std::string& output_path) const;
+    size_t done_count() const { return done.size(); }
+
+    // Record a finished output (thread-safe)
+    void record(const std::string& output_path, uint64_t size, const std::string& hash);
+
+    static std::string hash_hex(const uint8_t* data, size_t size);
+
+private:
+    // Read and verify the entries; true if the last line is torn
+    bool load(const std::string& path);
+    void run();
+    void write_pending(std::unique_lock<std::mutex>& lock);
+    bool write_all(const std::string& text);
+
+    int fd = -1;
+    std::unordered_set<std::string> done;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::string pending;
+    size_t pending_count = 0;
+    bool stopping = false;
+    std::thread flusher;
+};
+
+} // namespace fbiu
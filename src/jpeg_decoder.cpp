@@ -0,0 +1,567 @@
+#include "jpeg_decoder.h"
+
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <array>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FBIU_JPEG_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace fbiu {
+
+namespace {
+
+// Natural (row-major) index of each zigzag position
+const uint8_t ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+constexpr int FAST_BITS = 9;
+
+struct HuffmanTable {
+    bool defined = false;
+    uint16_t fast[1 << FAST_BITS];  // (length << 8) | symbol, 0 = slow path
+    int32_t max_code[17];           // Largest code of each length, -1 if none
+    int32_t value_offset[17];       // Symbol index = code + value_offset[length]
+    uint8_t values[256];
+    // AC tables only: run, size and coefficient value decoded by one lookup
+    // when code + magnitude bits fit in FAST_BITS:
+    // (value << 8) | (run << 4) | total bits, 0 = not available
+    int16_t fast_ac[1 << FAST_BITS];
+};
+
+bool build_huffman(HuffmanTable& table, const uint8_t counts[16], const uint8_t* values, int total) {
+    std::memcpy(table.values, values, static_cast<size_t>(total));
+    std::memset(table.fast, 0, sizeof(table.fast));
+    int32_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; ++len) {
+        const int n = counts[len - 1];
+        table.value_offset[len] = k - code;
+        for (int i = 0; i < n; ++i, ++code, ++k) {
+            if (code >= (1 << len)) return false;  // Over-subscribed
+            if (len <= FAST_BITS) {
+                const int shift = FAST_BITS - len;
+                for (int j = 0; j < (1 << shift); ++j) {
+                    table.fast[(code << shift) | j] = static_cast<uint16_t>((len << 8) | values[k]);
+                }
+            }
+        }
+        table.max_code[len] = n ? code - 1 : -1;
+        code <<= 1;
+    }
+
+    std::memset(table.fast_ac, 0, sizeof(table.fast_ac));
+    for (int i = 0; i < (1 << FAST_BITS); ++i) {
+        const int entry = table.fast[i];
+        if (!entry) continue;
+        const int len = entry >> 8;
+        const int run = (entry >> 4) & 15;
+        const int size = entry & 15;
+        if (size == 0 || len + size > FAST_BITS) continue;
+        // Magnitude bits follow the code within the same lookup index
+        const int bits = (i >> (FAST_BITS - len - size)) & ((1 << size) - 1);
+        const int value = bits < (1 << (size - 1)) ? bits - (1 << size) + 1 : bits;
+        if (value < -128 || value > 127) continue;
+        table.fast_ac[i] = static_cast<int16_t>((value * 256) | (run << 4) | (len + size));
+    }
+    table.defined = true;
+    return true;
+}
+
+// MSB-first entropy-coded segment reader (handles 0xFF00 stuffing;
+// stops feeding data at the first marker)
+class BitReader {
+public:
+    BitReader(const uint8_t* begin, const uint8_t* end) : p(begin), end(end) {}
+
+    void fill() {
+        while (count <= 24) {
+            uint32_t byte = 0;
+            if (!at_marker && p < end) {
+                byte = *p;
+                if (byte == 0xFF) {
+                    const uint8_t next = p + 1 < end ? p[1] : 0xD9;
+                    if (next == 0x00) {
+                        p += 2;
+                    } else {
+                        at_marker = true;
+                        byte = 0;
+                    }
+                } else {
+                    ++p;
+                }
+            }
+            buffer |= byte << (24 - count);
+            count += 8;
+        }
+    }
+
+    int decode(const HuffmanTable& table) {
+        if (count < 16) fill();
+        const uint32_t entry = table.fast[buffer >> (32 - FAST_BITS)];
+        if (entry) {
+            skip(static_cast<int>(entry >> 8));
+            return static_cast<int>(entry & 0xFF);
+        }
+        const uint32_t bits = buffer >> 16;
+        for (int len = FAST_BITS + 1; len <= 16; ++len) {
+            const int32_t code = static_cast<int32_t>(bits >> (16 - len));
+            if (code <= table.max_code[len]) {
+                skip(len);
+                return table.values[code + table.value_offset[len]];
+            }
+        }
+        return -1;
+    }
+
+    // Reads an s-bit magnitude and sign-extends it (JPEG "EXTEND")
+    int receive(int s) {
+        if (s == 0) return 0;
+        if (count < s) fill();
+        const uint32_t value = buffer >> (32 - s);
+        skip(s);
+        return value < (1u << (s - 1)) ? static_cast<int>(value) - (1 << s) + 1 : static_cast<int>(value);
+    }
+
+    void skip(int n) {
+        buffer <<= n;
+        count -= n;
+    }
+
+    int fast_ac(const HuffmanTable& table) {
+        if (count < 16) fill();
+        return table.fast_ac[buffer >> (32 - FAST_BITS)];
+    }
+
+    // Consumes an s-bit magnitude whose coefficient is not needed
+    void discard(int s) {
+        if (count < s) fill();
+        skip(s);
+    }
+
+    // Discard buffered bits and step over the next RSTn marker
+    void restart() {
+        buffer = 0;
+        count = 0;
+        at_marker = false;
+        while (p + 1 < end && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7)) ++p;
+        if (p + 1 < end) p += 2;
+    }
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t buffer = 0;
+    int count = 0;
+    bool at_marker = false;
+};
+
+// 1-D kernels of the reduced IDCT: K[x][u] = C(u)/2 * cos((2x+1)u*pi/2N).
+// Sampling the 8-point basis at the centre of each output pixel keeps the
+// JPEG normalisation, so a 1x1 "IDCT" is simply DC/8.
+struct IdctKernel {
+    float k[4][4];
+};
+
+const IdctKernel& idct_kernel(int n) {
+    static const std::array<IdctKernel, 3> kernels = [] {
+        constexpr double PI = 3.14159265358979323846;
+        std::array<IdctKernel, 3> result = {};
+        const int sizes[3] = {1, 2, 4};
+        for (int s = 0; s < 3; ++s) {
+            const int size = sizes[s];
+            for (int x = 0; x < size; ++x) {
+                for (int u = 0; u < size; ++u) {
+                    const double c = u == 0 ? std::sqrt(0.5) : 1.0;
+                    result[s].k[x][u] = static_cast<float>(0.5 * c * std::cos((2 * x + 1) * u * PI / (2.0 * size)));
+                }
+            }
+        }
+        return result;
+    }();
+    return kernels[n == 1 ? 0 : n == 2 ? 1 : 2];
+}
+
+inline uint8_t clamp_sample(float value) {
+    const long v = std::lrint(value + 128.0f);
+    return static_cast<uint8_t>(std::clamp(v, 0L, 255L));
+}
+
+// coef: n x n dequantised coefficients, row-major (v * n + u)
+void idct_reduced(const float* coef, int n, uint8_t* out, size_t stride) {
+    if (n == 1) {
+        out[0] = clamp_sample(coef[0] * 0.125f);
+        return;
+    }
+    const IdctKernel& kernel = idct_kernel(n);
+#ifdef FBIU_JPEG_SSE2
+    if (n == 4) {
+        // Columns of K as vectors over x, then rows over y
+        __m128 columns[4];
+        for (int u = 0; u < 4; ++u) {
+            columns[u] = _mm_setr_ps(kernel.k[0][u], kernel.k[1][u], kernel.k[2][u], kernel.k[3][u]);
+        }
+        __m128 rows[4];
+        for (int v = 0; v < 4; ++v) {
+            __m128 sum = _mm_mul_ps(_mm_set1_ps(coef[v * 4]), columns[0]);
+            for (int u = 1; u < 4; ++u) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(coef[v * 4 + u]), columns[u]));
+            }
+            rows[v] = sum;
+        }
+        const __m128 bias = _mm_set1_ps(128.0f);
+        for (int y = 0; y < 4; ++y) {
+            __m128 sum = bias;
+            for (int v = 0; v < 4; ++v) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.k[y][v]), rows[v]));
+            }
+            const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(sum), _mm_setzero_si128());
+            const int32_t pixels = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            std::memcpy(out + y * stride, &pixels, 4);
+        }
+        return;
+    }
+#endif
+    float rows[4][4];
+    for (int v = 0; v < n; ++v) {
+        for (int x = 0; x < n; ++x) {
+            float sum = 0.0f;
+            for (int u = 0; u < n; ++u) sum += coef[v * n + u] * kernel.k[x][u];
+            rows[v][x] = sum;
+        }
+    }
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            float sum = 0.0f;
+            for (int v = 0; v < n; ++v) sum += kernel.k[y][v] * rows[v][x];
+            out[y * stride + x] = clamp_sample(sum);
+        }
+    }
+}
+
+struct Component {
+    int id = 0;
+    int h = 1;
+    int v = 1;
+    int quant = 0;
+    int dc_table = 0;
+    int ac_table = 0;
+    int dc_pred = 0;
+    int plane_width = 0;
+    std::vector<uint8_t> plane;
+};
+
+// Bring a decoded component plane to the output size. Full-resolution
+// planes are cropped; subsampled chroma is interpolated bilinearly around
+// the sample centres (nearest-neighbour smears colour badly at 1/8 scale).
+void resample_plane(const Component& c, int h_max, int v_max, int out_width, int out_height, uint8_t* dst,
+                    size_t dst_stride) {
+    if (c.h == h_max && c.v == v_max) {
+        for (int y = 0; y < out_height; ++y) {
+            std::memcpy(dst + static_cast<size_t>(y) * dst_stride,
+                        c.plane.data() + static_cast<size_t>(y) * c.plane_width, static_cast<size_t>(out_width));
+        }
+        return;
+    }
+
+    const int plane_height = static_cast<int>(c.plane.size() / static_cast<size_t>(c.plane_width));
+    // Source position of an output pixel centre in 1/256 units
+    auto source_position = [](int i, int factor, int max_factor) {
+        return ((2 * i + 1) * factor * 256) / (2 * max_factor) - 128;
+    };
+    std::vector<int> x0(static_cast<size_t>(out_width));
+    std::vector<int> x1(static_cast<size_t>(out_width));
+    std::vector<int> fx(static_cast<size_t>(out_width));
+    for (int x = 0; x < out_width; ++x) {
+        const int pos = std::max(source_position(x, c.h, h_max), 0);
+        x0[x] = std::min(pos >> 8, c.plane_width - 1);
+        x1[x] = std::min(x0[x] + 1, c.plane_width - 1);
+        fx[x] = pos & 255;
+    }
+    for (int y = 0; y < out_height; ++y) {
+        const int pos = std::max(source_position(y, c.v, v_max), 0);
+        const int y0 = std::min(pos >> 8, plane_height - 1);
+        const int y1 = std::min(y0 + 1, plane_height - 1);
+        const int fy = pos & 255;
+        const uint8_t* row0 = c.plane.data() + static_cast<size_t>(y0) * c.plane_width;
+        const uint8_t* row1 = c.plane.data() + static_cast<size_t>(y1) * c.plane_width;
+        uint8_t* out_row = dst + static_cast<size_t>(y) * dst_stride;
+        for (int x = 0; x < out_width; ++x) {
+            const int top = row0[x0[x]] * (256 - fx[x]) + row0[x1[x]] * fx[x];
+            const int bottom = row1[x0[x]] * (256 - fx[x]) + row1[x1[x]] * fx[x];
+            out_row[x] = static_cast<uint8_t>((top * (256 - fy) + bottom * fy + 32768) >> 16);
+        }
+    }
+}
+
+// Decodes one block, keeping only the n x n low-frequency coefficients
+bool decode_block(BitReader& reader, const HuffmanTable& dc, const HuffmanTable& ac,
+                  const uint16_t* quant, int& dc_pred, int n, float* coef) {
+    const int s = reader.decode(dc);
+    if (s < 0 || s > 16) return false;
+    dc_pred += reader.receive(s);
+    std::fill(coef, coef + n * n, 0.0f);
+    coef[0] = static_cast<float>(dc_pred * quant[0]);
+
+    for (int k = 1; k < 64;) {
+        const int fast = reader.fast_ac(ac);
+        if (fast) {
+            reader.skip(fast & 15);
+            k += (fast >> 4) & 15;
+            if (k > 63) return false;
+            const int natural = ZIGZAG[k];
+            if ((natural >> 3) < n && (natural & 7) < n) {
+                coef[(natural >> 3) * n + (natural & 7)] = static_cast<float>((fast >> 8) * quant[k]);
+            }
+            ++k;
+            continue;
+        }
+        const int rs = reader.decode(ac);
+        if (rs < 0) return false;
+        const int run = rs >> 4;
+        const int size = rs & 15;
+        if (size == 0) {
+            if (run != 15) break;  // End of block
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) return false;
+        const int natural = ZIGZAG[k];
+        const int row = natural >> 3;
+        const int col = natural & 7;
+        if (row < n && col < n) {
+            coef[row * n + col] = static_cast<float>(reader.receive(size) * quant[k]);
+        } else {
+            reader.discard(size);
+        }
+        ++k;
+    }
+    return true;
+}
+
+inline uint16_t read_be16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+} // namespace
+
+bool decode_jpeg_scaled(const uint8_t* data, size_t size, int max_width, int max_height, ImageData& out) {
+    if (!data || size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+    if (max_width <= 0 && max_height <= 0) return false;
+
+    uint16_t quant[4][64] = {};
+    HuffmanTable dc_tables[4];
+    HuffmanTable ac_tables[4];
+    std::vector<Component> components;
+    int width = 0;
+    int height = 0;
+    int restart_interval = 0;
+
+    size_t pos = 2;
+    while (true) {
+        // Find the next marker, skipping fill bytes
+        while (pos < size && data[pos] != 0xFF) ++pos;
+        while (pos < size && data[pos] == 0xFF) ++pos;
+        if (pos >= size) return false;
+        const uint8_t marker = data[pos++];
+
+        if (marker == 0xD9) return false;  // EOI before any scan
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) continue;
+
+        if (size - pos < 2) return false;
+        const size_t length = read_be16(data + pos);
+        if (length < 2 || length > size - pos) return false;
+        const uint8_t* segment = data + pos + 2;
+        const size_t segment_size = length - 2;
+        pos += length;
+
+        switch (marker) {
+            case 0xDB: {  // DQT
+                size_t i = 0;
+                while (i < segment_size) {
+                    const int precision = segment[i] >> 4;
+                    const int id = segment[i] & 15;
+                    ++i;
+                    const size_t bytes = precision ? 128 : 64;
+                    if (id > 3 || segment_size - i < bytes) return false;
+                    for (int k = 0; k < 64; ++k) {
+                        quant[id][k] = precision ? read_be16(segment + i + k * 2) : segment[i + k];
+                    }
+                    i += bytes;
+                }
+                break;
+            }
+            case 0xC4: {  // DHT
+                size_t i = 0;
+                while (i < segment_size) {
+                    if (segment_size - i < 17) return false;
+                    const int table_class = segment[i] >> 4;
+                    const int id = segment[i] & 15;
+                    const uint8_t* counts = segment + i + 1;
+                    int total = 0;
+                    for (int k = 0; k < 16; ++k) total += counts[k];
+                    i += 17;
+                    if (table_class > 1 || id > 3 || total > 256 || segment_size - i < static_cast<size_t>(total)) return false;
+                    HuffmanTable& table = table_class == 0 ? dc_tables[id] : ac_tables[id];
+                    if (!build_huffman(table, counts, segment + i, total)) return false;
+                    i += static_cast<size_t>(total);
+                }
+                break;
+            }
+            case 0xC0:
+            case 0xC1: {  // SOF0 / SOF1: sequential Huffman
+                if (segment_size < 6 || segment[0] != 8) return false;
+                height = read_be16(segment + 1);
+                width = read_be16(segment + 3);
+                const int count = segment[5];
+                if (width == 0 || height == 0 || (count != 1 && count != 3)) return false;
+                if (segment_size < 6 + static_cast<size_t>(count) * 3) return false;
+                components.resize(static_cast<size_t>(count));
+                for (int c = 0; c < count; ++c) {
+                    const uint8_t* entry = segment + 6 + c * 3;
+                    components[c].id = entry[0];
+                    components[c].h = entry[1] >> 4;
+                    components[c].v = entry[1] & 15;
+                    components[c].quant = entry[2];
+                    if (components[c].h < 1 || components[c].h > 4 || components[c].v < 1 ||
+                        components[c].v > 4 || components[c].quant > 3) {
+                        return false;
+                    }
+                }
+                // A single-component scan is not interleaved: one block per "MCU"
+                if (count == 1) components[0].h = components[0].v = 1;
+                break;
+            }
+            case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                return false;  // Progressive, lossless, hierarchical or arithmetic
+            case 0xDD:  // DRI
+                if (segment_size < 2) return false;
+                restart_interval = read_be16(segment);
+                break;
+            case 0xEE:  // APP14: Adobe colour transforms are left to stb
+                if (segment_size >= 5 && std::memcmp(segment, "Adobe", 5) == 0) return false;
+                break;
+            case 0xDA: {  // SOS
+                if (components.empty() || segment_size < 1) return false;
+                const int count = segment[0];
+                if (count != static_cast<int>(components.size()) || segment_size < 1 + static_cast<size_t>(count) * 2) {
+                    return false;  // Non-interleaved multi-scan files are left to stb
+                }
+                for (int i = 0; i < count; ++i) {
+                    const int id = segment[1 + i * 2];
+                    const int tables = segment[2 + i * 2];
+                    auto it = std::find_if(components.begin(), components.end(),
+                                           [id](const Component& c) { return c.id == id; });
+                    if (it == components.end()) return false;
+                    it->dc_table = tables >> 4;
+                    it->ac_table = tables & 15;
+                    if (it->dc_table > 3 || it->ac_table > 3 ||
+                        !dc_tables[it->dc_table].defined || !ac_tables[it->ac_table].defined) {
+                        return false;
+                    }
+                }
+
+                // Largest reduction that still covers the requested size
+                const double ratio = std::max(max_width > 0 ? static_cast<double>(width) / max_width : 0.0,
+                                              max_height > 0 ? static_cast<double>(height) / max_height : 0.0);
+                int denom = 8;
+                while (denom > 1 && denom > ratio) denom /= 2;
+                if (denom == 1) return false;
+                const int n = 8 / denom;
+
+                int h_max = 1;
+                int v_max = 1;
+                for (const auto& c : components) {
+                    h_max = std::max(h_max, c.h);
+                    v_max = std::max(v_max, c.v);
+                }
+                const int mcus_x = (width + 8 * h_max - 1) / (8 * h_max);
+                const int mcus_y = (height + 8 * v_max - 1) / (8 * v_max);
+                for (auto& c : components) {
+                    c.plane_width = mcus_x * c.h * n;
+                    c.plane.resize(static_cast<size_t>(c.plane_width) * mcus_y * c.v * n);
+                }
+
+                BitReader reader(data + pos, data + size);
+                float coef[16];
+                int mcu_index = 0;
+                for (int my = 0; my < mcus_y; ++my) {
+                    for (int mx = 0; mx < mcus_x; ++mx, ++mcu_index) {
+                        if (restart_interval && mcu_index && mcu_index % restart_interval == 0) {
+                            reader.restart();
+                            for (auto& c : components) c.dc_pred = 0;
+                        }
+                        for (auto& c : components) {
+                            for (int by = 0; by < c.v; ++by) {
+                                for (int bx = 0; bx < c.h; ++bx) {
+                                    if (!decode_block(reader, dc_tables[c.dc_table], ac_tables[c.ac_table],
+                                                      quant[c.quant], c.dc_pred, n, coef)) {
+                                        return false;
+                                    }
+                                    const size_t row = static_cast<size_t>(my * c.v + by) * n;
+                                    const size_t col = static_cast<size_t>(mx * c.h + bx) * n;
+                                    idct_reduced(coef, n, c.plane.data() + row * c.plane_width + col,
+                                                 static_cast<size_t>(c.plane_width));
+                                }
+                            }
+                        }
+                    }
+                }
+
+                const int out_width = (width + denom - 1) / denom;
+                const int out_height = (height + denom - 1) / denom;
+                const int channels = components.size() == 1 ? 1 : 3;
+                out = ImageData::allocate(out_width, out_height, channels);
+                if (!out.is_valid()) return false;
+
+                if (channels == 1) {
+                    resample_plane(components[0], h_max, v_max, out_width, out_height, out.data(), out.stride);
+                    return true;
+                }
+
+                // JFIF YCbCr -> RGB on planes brought to the output size
+                const size_t plane_size = static_cast<size_t>(out_width) * out_height;
+                std::vector<uint8_t> planes(plane_size * 3);
+                for (int c = 0; c < 3; ++c) {
+                    resample_plane(components[c], h_max, v_max, out_width, out_height, planes.data() + plane_size * c,
+                                   static_cast<size_t>(out_width));
+                }
+                const uint8_t* y_plane = planes.data();
+                const uint8_t* cb_plane = y_plane + plane_size;
+                const uint8_t* cr_plane = cb_plane + plane_size;
+                for (int y = 0; y < out_height; ++y) {
+                    const size_t base = static_cast<size_t>(y) * out_width;
+                    uint8_t* dst = out.row(y);
+                    for (int x = 0; x < out_width; ++x) {
+                        const size_t i = base + x;
+                        const int luma = y_plane[i] << 16;
+                        const int blue = cb_plane[i] - 128;
+                        const int red = cr_plane[i] - 128;
+                        // 16.16 fixed point: 1.402, 0.344136, 0.714136, 1.772
+                        const int r = (luma + 91881 * red + 32768) >> 16;
+                        const int g = (luma - 22554 * blue - 46802 * red + 32768) >> 16;
+                        const int b = (luma + 116130 * blue + 32768) >> 16;
+                        dst[x * 3 + 0] = static_cast<uint8_t>(std::clamp(r, 0, 255));
+                        dst[x * 3 + 1] = static_cast<uint8_t>(std::clamp(g, 0, 255));
+                        dst[x * 3 + 2] = static_cast<uint8_t>(std::clamp(b, 0, 255));
+                    }
+                }
+                return true;
+            }
+            default:
+                break;  // APPn, COM and other segments are skipped
+        }
+    }
+}
+
+} // namespace fbiu
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "image_processor.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace fbiu {
+
+// Reduced-size JPEG decoder for previews and downscaled outputs.
+//
+// The image is decoded directly at 1/2, 1/4 or 1/8 of its size by running
+// a 4x4, 2x2 or 1x1 IDCT on the low-frequency corner of each 8x8 block
+// (DCT-domain scaling), so full-resolution pixels are never produced.
+// The scale is the smallest one that still covers max_width x max_height
+// when fitted with the aspect ratio kept.
+//
+// Supports baseline / extended sequential Huffman JPEGs with 8-bit samples,
+// 1 (gray) or 3 (YCbCr) components, any sampling factors and restart
+// intervals. Returns false when the image is progressive, arithmetic-coded,
+// CMYK / Adobe-transformed, corrupt, or needs no reduction at all; the
+// caller then decodes at full size with stb_image.
+bool decode_jpeg_scaled(const uint8_t* data, size_t size, int max_width, int max_height, ImageData& out);
+
+} // namespace fbiu
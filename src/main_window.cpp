@@ -1,4 +1,5 @@
 ﻿#include "main_window.h"
+#include "progress.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFileDialog>
@@ -14,12 +15,28 @@
 #include <QFileInfo>
 #include <QMenuBar>
 #include <QSettings>
+#include <QEventLoop>
+#include <QTimer>
+#include <atomic>
 #include <filesystem>
+#include <thread>
 
 namespace fs = std::filesystem;
 
 namespace fbiu {
 
+// QImage over the pixels of `image` without copying; the QImage keeps a
+// reference to the storage until it is destroyed
+static QImage to_qimage(const ImageData& image) {
+    QImage::Format format = QImage::Format_RGB888;
+    if (image.channels == 4) format = QImage::Format_RGBA8888;
+    else if (image.channels == 1) format = QImage::Format_Grayscale8;
+    
+    auto* ref = new ImageData(image);
+    return QImage(ref->data(), ref->width, ref->height, static_cast<qsizetype>(ref->stride), format,
+                  [](void* info) { delete static_cast<ImageData*>(info); }, ref);
+}
+
 MainWindow::MainWindow(QWidget* parent) 
     : QMainWindow(parent), current_function(ProcessFunction::LUMA_TO_ALPHA) {
     setWindowTitle("Fast Batch Image Utility");
@@ -261,7 +278,7 @@ void MainWindow::select_input_folder() {
 void MainWindow::select_input_file() {
     QString file = QFileDialog::getOpenFileName(
         this, tr("Select Input File"), input_file,
-        tr("Image Files (*.png *.jpg *.jpeg *.tif *.tiff *.tga *.bmp)"));
+        tr("Image Files (*.png *.jpg *.jpeg *.tif *.tiff *.tga *.bmp *.qoi *.fbraw)"));
     
     if (!file.isEmpty()) {
         input_file = file;
@@ -331,14 +348,15 @@ void MainWindow::execute_batch() {
         options.function = current_function;
         options.luma_threshold = DEFAULT_LUMA_THRESHOLD;  // For standard LUMA_TO_ALPHA
         options.custom_params = current_custom_params;  // For LUMA_TO_ALPHA_CUSTOM
-        options.progress_callback = [this](int completed, int total, const std::string& filename) {
-            int progress = (completed * 100) / total;
-            QMetaObject::invokeMethod(this, [this, progress]() {
-                progress_bar->setValue(progress);
-            }, Qt::QueuedConnection);
-        };
         
-        success = ImageProcessor::batch_process(options);
+        // Hand the batch to a resident fbiu_server when one is configured
+        QString server_socket = qEnvironmentVariable("FBIU_SERVER");
+        ServerClient client;
+        if (!server_socket.isEmpty() && client.connect(server_socket.toStdString())) {
+            success = run_on_server(client, options);
+        } else {
+            success = run_locally(options);
+        }
     }
     
     execute_button->setEnabled(true);
@@ -356,6 +374,59 @@ void MainWindow::execute_batch() {
     }
 }
 
+bool MainWindow::run_on_server(ServerClient& client, const ImageProcessor::BatchOptions& options) {
+    int job = client.submit(options);
+    if (job < 0) return false;
+    
+    // Polled from a timer like run_locally, so the window keeps repainting
+    // between STATUS requests
+    JobStatus status;
+    QEventLoop loop;
+    QTimer timer;
+    connect(&timer, &QTimer::timeout, &loop, [&]() {
+        if (!client.status(job, status)) {
+            status.state.clear();
+            loop.quit();
+            return;
+        }
+        if (status.total > 0) {
+            progress_bar->setValue((status.completed * 100) / status.total);
+        }
+        if (status.state != "queued" && status.state != "running") loop.quit();
+    });
+    timer.start(100);
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+    return status.state == "done";
+}
+
+bool MainWindow::run_locally(ImageProcessor::BatchOptions options) {
+    // The batch runs on its own thread and only bumps counters; a timer
+    // samples them, so the window repaints at a fixed rate however many
+    // files finish in between
+    BatchProgress progress;
+    options.progress = &progress;
+    std::atomic<bool> finished{false};
+    bool success = false;
+    std::thread batch([&]() {
+        success = ImageProcessor::batch_process(options);
+        finished = true;
+    });
+    
+    QEventLoop loop;
+    QTimer timer;
+    connect(&timer, &QTimer::timeout, &loop, [&]() {
+        const int total = progress.total.load(std::memory_order_relaxed);
+        if (total > 0) {
+            progress_bar->setValue((progress.completed.load(std::memory_order_relaxed) * 100) / total);
+        }
+        if (finished) loop.quit();
+    });
+    timer.start(100);
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+    batch.join();
+    return success;
+}
+
 void MainWindow::function_changed(int index) {
     current_function = static_cast<ProcessFunction>(
         function_combo->itemData(index).toInt());
@@ -424,7 +495,7 @@ void MainWindow::update_preview() {
         // Find first image in input folder for preview
         QDir dir(input_folder);
         QStringList filters;
-        filters << "*.png" << "*.jpg" << "*.jpeg" << "*.tif" << "*.tiff" << "*.tga" << "*.bmp";
+        filters << "*.png" << "*.jpg" << "*.jpeg" << "*.tif" << "*.tiff" << "*.tga" << "*.bmp" << "*.qoi" << "*.fbraw";
         QStringList files = dir.entryList(filters, QDir::Files);
         
         if (files.isEmpty()) {
@@ -442,13 +513,12 @@ void MainWindow::update_preview() {
     
     if (preview_file.isEmpty()) return;
     
-    // Load and display before
-    ImageData before = ImageProcessor::load_image(preview_file.toStdString());
+    // Load and display before (JPEGs are decoded at reduced size to fit the label)
+    ImageData before = ImageProcessor::load_image_scaled(preview_file.toStdString(),
+        preview_before_label->width(), preview_before_label->height());
     if (!before.is_valid()) return;
     
-    QImage qimg_before(before.pixels.data(), before.width, before.height,
-                      before.width * before.channels,
-                      before.channels == 4 ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    QImage qimg_before = to_qimage(before);
     
     QPixmap pix_before = QPixmap::fromImage(qimg_before).scaled(
         preview_before_label->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
@@ -464,9 +534,7 @@ void MainWindow::update_preview() {
     
     if (!after.is_valid()) return;
     
-    QImage qimg_after(after.pixels.data(), after.width, after.height,
-                     after.width * after.channels,
-                     after.channels == 4 ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    QImage qimg_after = to_qimage(after);
     
     // Apply preview mode
     int preview_mode = preview_mode_combo->currentIndex();
@@ -0,0 +1,666 @@
+#include "png_decoder.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FBIU_PNG_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace fbiu {
+
+namespace {
+
+// ---- Inflate (RFC 1951) ----
+
+constexpr int FAST_BITS = 11;
+constexpr uint32_t FAST_MASK = (1u << FAST_BITS) - 1;
+
+// Fast table entry layout:
+//   bits 0-4   code length in bits (0 = use the slow path)
+//   bits 5-13  first symbol
+//   bits 14-21 second literal (pair entries only)
+//   bit 31     pair entry: two literals decoded by one lookup
+constexpr uint32_t PAIR_FLAG = 1u << 31;
+
+struct Huffman {
+    uint32_t fast[1 << FAST_BITS];
+    uint16_t count[16];     // Number of codes of each length
+    uint16_t symbols[288];  // Symbols ordered by code (canonical)
+};
+
+const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                8193, 12289, 16385, 24577};
+const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+inline uint32_t reverse_bits(uint32_t code, int length) {
+    uint32_t result = 0;
+    for (int i = 0; i < length; ++i) {
+        result = (result << 1) | (code & 1);
+        code >>= 1;
+    }
+    return result;
+}
+
+bool build_huffman(Huffman& h, const uint8_t* lengths, int n, bool literal_pairs) {
+    std::memset(h.count, 0, sizeof(h.count));
+    for (int i = 0; i < n; ++i) h.count[lengths[i]]++;
+    h.count[0] = 0;
+
+    // Reject over-subscribed codes (incomplete ones are legal)
+    int left = 1;
+    for (int len = 1; len < 16; ++len) {
+        left = (left << 1) - h.count[len];
+        if (left < 0) return false;
+    }
+
+    uint16_t offsets[16];
+    uint32_t next_code[16];
+    offsets[1] = 0;
+    next_code[1] = 0;
+    for (int len = 1; len < 15; ++len) {
+        offsets[len + 1] = static_cast<uint16_t>(offsets[len] + h.count[len]);
+        next_code[len + 1] = (next_code[len] + h.count[len]) << 1;
+    }
+
+    std::memset(h.fast, 0, sizeof(h.fast));
+    for (int sym = 0; sym < n; ++sym) {
+        const int len = lengths[sym];
+        if (len == 0) continue;
+        h.symbols[offsets[len]++] = static_cast<uint16_t>(sym);
+        const uint32_t code = next_code[len]++;
+        if (len <= FAST_BITS) {
+            const uint32_t entry = static_cast<uint32_t>(len) | (static_cast<uint32_t>(sym) << 5);
+            for (uint32_t j = reverse_bits(code, len); j < (1u << FAST_BITS); j += 1u << len) {
+                h.fast[j] = entry;
+            }
+        }
+    }
+
+    if (literal_pairs) {
+        // Descending order: fast[i >> len1] is still a single-symbol entry
+        for (int i = (1 << FAST_BITS) - 1; i >= 0; --i) {
+            const uint32_t first = h.fast[i];
+            const uint32_t len1 = first & 31;
+            const uint32_t sym1 = (first >> 5) & 511;
+            if (len1 == 0 || sym1 >= 256) continue;
+            const uint32_t second = h.fast[static_cast<uint32_t>(i) >> len1];
+            const uint32_t len2 = second & 31;
+            const uint32_t sym2 = (second >> 5) & 511;
+            if (len2 == 0 || sym2 >= 256 || len1 + len2 > FAST_BITS) continue;
+            h.fast[i] = PAIR_FLAG | (len1 + len2) | (sym1 << 5) | (sym2 << 14);
+        }
+    }
+    return true;
+}
+
+class Inflater {
+public:
+    // Zero bytes the input must be followed by: refill() loads 8 bytes at a
+    // time and stops reading once overrun() holds, i.e. from in_end + 9 on
+    static constexpr size_t PADDING = 16;
+
+    // `in` must be followed by PADDING readable bytes
+    Inflater(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size)
+        : in(in), in_end(in + in_size), out(out), out_size(out_size) {}
+
+    // Inflate until the stream ends. `on_progress(bytes_out)` is called
+    // every PROGRESS_INTERVAL bytes so the caller can consume finished rows.
+    template <typename Progress>
+    bool run(Progress&& on_progress) {
+        size_t next_progress = PROGRESS_INTERVAL;
+        bool last = false;
+        while (!last) {
+            refill();
+            last = take(1) != 0;
+            const uint32_t type = take(2);
+            bool ok;
+            if (type == 0) {
+                ok = stored_block();
+            } else if (type == 1) {
+                ok = huffman_block(fixed_litlen(), fixed_dist(), next_progress, on_progress);
+            } else if (type == 2) {
+                ok = dynamic_block(next_progress, on_progress);
+            } else {
+                ok = false;
+            }
+            if (!ok || overrun()) return false;
+        }
+        return true;
+    }
+
+    size_t produced() const { return pos; }
+
+private:
+    static constexpr size_t PROGRESS_INTERVAL = 64 * 1024;
+
+    // Bits consumed past the real end of the input mean a truncated stream
+    bool overrun() const {
+        return in > in_end + 8;
+    }
+
+    void refill() {
+        // A truncated stream has run past its padding; feed zero bits without
+        // reading further (callers stop on overrun())
+        if (overrun()) {
+            bit_count |= 56;
+            return;
+        }
+        // Refill to 56..63 buffered bits (input is padded)
+        uint64_t word;
+        std::memcpy(&word, in, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        bit_buffer |= word << bit_count;
+        in += (63 - bit_count) >> 3;
+        bit_count |= 56;
+    }
+
+    uint32_t take(int n) {
+        const uint32_t value = static_cast<uint32_t>(bit_buffer & ((uint64_t(1) << n) - 1));
+        bit_buffer >>= n;
+        bit_count -= n;
+        return value;
+    }
+
+    void align_to_byte() {
+        take(bit_count & 7);
+    }
+
+    // Canonical bit-by-bit decode for codes longer than FAST_BITS
+    int decode_slow(const Huffman& h) {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int len = 1; len < 16; ++len) {
+            code |= static_cast<int>(take(1));
+            const int count = h.count[len];
+            if (code - count < first) return h.symbols[index + (code - first)];
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    int decode(const Huffman& h) {
+        const uint32_t entry = h.fast[bit_buffer & FAST_MASK];
+        if (entry & 31) {
+            take(entry & 31);
+            return static_cast<int>((entry >> 5) & 511);
+        }
+        return decode_slow(h);
+    }
+
+    bool stored_block() {
+        align_to_byte();
+        // Return whole unread bytes from the bit buffer to the input
+        in -= bit_count >> 3;
+        bit_buffer = 0;
+        bit_count = 0;
+        if (in_end - in < 4) return false;
+        const uint32_t len = in[0] | (in[1] << 8);
+        const uint32_t nlen = in[2] | (in[3] << 8);
+        if ((len ^ 0xFFFF) != nlen) return false;
+        in += 4;
+        if (static_cast<size_t>(in_end - in) < len || out_size - pos < len) return false;
+        std::memcpy(out + pos, in, len);
+        in += len;
+        pos += len;
+        return true;
+    }
+
+    template <typename Progress>
+    bool huffman_block(const Huffman& litlen, const Huffman& dist, size_t& next_progress, Progress& on_progress) {
+        while (true) {
+            if (bit_count < 48) refill();
+            if (overrun()) return false;
+
+            const uint32_t entry = litlen.fast[bit_buffer & FAST_MASK];
+            int sym;
+            if (entry & PAIR_FLAG) {
+                take(entry & 31);
+                if (out_size - pos < 2) return false;
+                out[pos++] = static_cast<uint8_t>((entry >> 5) & 255);
+                out[pos++] = static_cast<uint8_t>((entry >> 14) & 255);
+                continue;
+            }
+            if (entry & 31) {
+                take(entry & 31);
+                sym = static_cast<int>((entry >> 5) & 511);
+            } else {
+                sym = decode_slow(litlen);
+                if (sym < 0) return false;
+            }
+
+            if (sym < 256) {
+                if (pos >= out_size) return false;
+                out[pos++] = static_cast<uint8_t>(sym);
+                continue;
+            }
+            if (sym == 256) return true;
+
+            sym -= 257;
+            if (sym >= 29) return false;
+            const size_t length = LENGTH_BASE[sym] + take(LENGTH_EXTRA[sym]);
+
+            const int dist_sym = decode(dist);
+            if (dist_sym < 0 || dist_sym >= 30) return false;
+            if (bit_count < 16) refill();
+            const size_t distance = DIST_BASE[dist_sym] + take(DIST_EXTRA[dist_sym]);
+            if (distance > pos || out_size - pos < length) return false;
+
+            copy_match(distance, length);
+
+            if (pos >= next_progress) {
+                on_progress(pos);
+                next_progress = pos + PROGRESS_INTERVAL;
+            }
+        }
+    }
+
+    void copy_match(size_t distance, size_t length) {
+        uint8_t* dst = out + pos;
+        const uint8_t* src = dst - distance;
+        if (distance >= 8 && out_size - pos >= length + 8) {
+            // Each 8-byte chunk only reads bytes that are already written;
+            // the tail overshoot lands in space that is rewritten later
+            for (size_t i = 0; i < length; i += 8) {
+                uint64_t chunk;
+                std::memcpy(&chunk, src + i, 8);
+                std::memcpy(dst + i, &chunk, 8);
+            }
+        } else if (distance == 1) {
+            std::memset(dst, *src, length);
+        } else {
+            for (size_t i = 0; i < length; ++i) dst[i] = src[i];
+        }
+        pos += length;
+    }
+
+    template <typename Progress>
+    bool dynamic_block(size_t& next_progress, Progress& on_progress) {
+        static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        refill();
+        if (overrun()) return false;
+        const int hlit = static_cast<int>(take(5)) + 257;
+        const int hdist = static_cast<int>(take(5)) + 1;
+        const int hclen = static_cast<int>(take(4)) + 4;
+        if (hlit > 286 || hdist > 30) return false;
+
+        uint8_t code_lengths[19] = {};
+        for (int i = 0; i < hclen; ++i) {
+            if (bit_count < 3) refill();
+            if (overrun()) return false;
+            code_lengths[ORDER[i]] = static_cast<uint8_t>(take(3));
+        }
+        Huffman code_huffman;
+        if (!build_huffman(code_huffman, code_lengths, 19, false)) return false;
+
+        uint8_t lengths[286 + 30] = {};
+        int n = 0;
+        while (n < hlit + hdist) {
+            if (bit_count < 24) refill();
+            if (overrun()) return false;
+            const int sym = decode(code_huffman);
+            if (sym < 0) return false;
+            if (sym < 16) {
+                lengths[n++] = static_cast<uint8_t>(sym);
+                continue;
+            }
+            int repeat;
+            uint8_t value = 0;
+            if (sym == 16) {
+                if (n == 0) return false;
+                value = lengths[n - 1];
+                repeat = 3 + static_cast<int>(take(2));
+            } else if (sym == 17) {
+                repeat = 3 + static_cast<int>(take(3));
+            } else {
+                repeat = 11 + static_cast<int>(take(7));
+            }
+            if (n + repeat > hlit + hdist) return false;
+            std::memset(lengths + n, value, static_cast<size_t>(repeat));
+            n += repeat;
+        }
+        if (lengths[256] == 0) return false;
+
+        if (!build_huffman(litlen, lengths, hlit, true)) return false;
+        if (!build_huffman(dist, lengths + hlit, hdist, false)) return false;
+        return huffman_block(litlen, dist, next_progress, on_progress);
+    }
+
+    static const Huffman& fixed_litlen() {
+        static const Huffman table = [] {
+            uint8_t lengths[288];
+            std::memset(lengths, 8, 144);
+            std::memset(lengths + 144, 9, 112);
+            std::memset(lengths + 256, 7, 24);
+            std::memset(lengths + 280, 8, 8);
+            Huffman h;
+            build_huffman(h, lengths, 288, true);
+            return h;
+        }();
+        return table;
+    }
+
+    static const Huffman& fixed_dist() {
+        static const Huffman table = [] {
+            uint8_t lengths[30];
+            std::memset(lengths, 5, 30);
+            Huffman h;
+            build_huffman(h, lengths, 30, false);
+            return h;
+        }();
+        return table;
+    }
+
+    const uint8_t* in;
+    const uint8_t* in_end;
+    uint8_t* out;
+    size_t out_size;
+    size_t pos = 0;
+    uint64_t bit_buffer = 0;
+    int bit_count = 0;
+    Huffman litlen;
+    Huffman dist;
+};
+
+// ---- Unfiltering (PNG filter types 0-4) ----
+
+inline uint8_t paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    if (pb <= pc) return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+}
+
+void unfilter_scalar(int type, uint8_t* cur, const uint8_t* src, const uint8_t* prev, size_t n, int bpp) {
+    switch (type) {
+        case 0:
+            std::memcpy(cur, src, n);
+            break;
+        case 1:
+            for (size_t i = 0; i < n; ++i) {
+                cur[i] = static_cast<uint8_t>(src[i] + (i >= static_cast<size_t>(bpp) ? cur[i - bpp] : 0));
+            }
+            break;
+        case 2:
+            for (size_t i = 0; i < n; ++i) cur[i] = static_cast<uint8_t>(src[i] + prev[i]);
+            break;
+        case 3:
+            for (size_t i = 0; i < n; ++i) {
+                const int left = i >= static_cast<size_t>(bpp) ? cur[i - bpp] : 0;
+                cur[i] = static_cast<uint8_t>(src[i] + ((left + prev[i]) >> 1));
+            }
+            break;
+        case 4:
+            for (size_t i = 0; i < n; ++i) {
+                const bool has_left = i >= static_cast<size_t>(bpp);
+                cur[i] = static_cast<uint8_t>(src[i] + paeth(has_left ? cur[i - bpp] : 0, prev[i],
+                                                             has_left ? prev[i - bpp] : 0));
+            }
+            break;
+    }
+}
+
+#ifdef FBIU_PNG_SSE2
+
+template <int BPP>
+inline __m128i load_pixel(const uint8_t* p) {
+    int32_t value = 0;
+    std::memcpy(&value, p, BPP);
+    return _mm_cvtsi32_si128(value);
+}
+
+template <int BPP>
+inline void store_pixel(uint8_t* p, __m128i v) {
+    const int32_t value = _mm_cvtsi128_si32(v);
+    std::memcpy(p, &value, BPP);
+}
+
+inline __m128i abs_epi16(__m128i x) {
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+void unfilter_up_sse2(uint8_t* cur, const uint8_t* src, const uint8_t* prev, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cur + i), _mm_add_epi8(s, b));
+    }
+    for (; i < n; ++i) cur[i] = static_cast<uint8_t>(src[i] + prev[i]);
+}
+
+// One pixel (3 or 4 bytes) per step; the left neighbour stays in a register
+template <int BPP>
+void unfilter_sub_sse2(uint8_t* cur, const uint8_t* src, size_t n) {
+    __m128i a = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += BPP) {
+        a = _mm_add_epi8(load_pixel<BPP>(src + i), a);
+        store_pixel<BPP>(cur + i, a);
+    }
+}
+
+template <int BPP>
+void unfilter_avg_sse2(uint8_t* cur, const uint8_t* src, const uint8_t* prev, size_t n) {
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += BPP) {
+        const __m128i b = load_pixel<BPP>(prev + i);
+        // floor((a + b) / 2) from the rounding-up average
+        __m128i avg = _mm_avg_epu8(a, b);
+        avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), one));
+        a = _mm_add_epi8(load_pixel<BPP>(src + i), avg);
+        store_pixel<BPP>(cur + i, a);
+    }
+}
+
+template <int BPP>
+void unfilter_paeth_sse2(uint8_t* cur, const uint8_t* src, const uint8_t* prev, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a16 = zero;  // left, widened to 16 bits
+    __m128i c16 = zero;  // upper left
+    for (size_t i = 0; i < n; i += BPP) {
+        const __m128i b16 = _mm_unpacklo_epi8(load_pixel<BPP>(prev + i), zero);
+        const __m128i pa_raw = _mm_sub_epi16(b16, c16);   // p - a
+        const __m128i pb_raw = _mm_sub_epi16(a16, c16);   // p - b
+        const __m128i pa = abs_epi16(pa_raw);
+        const __m128i pb = abs_epi16(pb_raw);
+        const __m128i pc = abs_epi16(_mm_add_epi16(pa_raw, pb_raw));
+        const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        // Priority a, then b, then c (as in the scalar predictor)
+        __m128i nearest = select(_mm_cmpeq_epi16(smallest, pc), c16, a16);
+        nearest = select(_mm_cmpeq_epi16(smallest, pb), b16, nearest);
+        nearest = select(_mm_cmpeq_epi16(smallest, pa), a16, nearest);
+        const __m128i result = _mm_add_epi8(load_pixel<BPP>(src + i), _mm_packus_epi16(nearest, nearest));
+        store_pixel<BPP>(cur + i, result);
+        a16 = _mm_unpacklo_epi8(result, zero);
+        c16 = b16;
+    }
+}
+
+template <int BPP>
+bool unfilter_pixels_sse2(int type, uint8_t* cur, const uint8_t* src, const uint8_t* prev, size_t n) {
+    switch (type) {
+        case 1: unfilter_sub_sse2<BPP>(cur, src, n); return true;
+        case 3: unfilter_avg_sse2<BPP>(cur, src, prev, n); return true;
+        case 4: unfilter_paeth_sse2<BPP>(cur, src, prev, n); return true;
+        default: return false;
+    }
+}
+
+#endif // FBIU_PNG_SSE2
+
+void unfilter_row(int type, uint8_t* cur, const uint8_t* src, const uint8_t* prev, size_t n, int bpp) {
+#ifdef FBIU_PNG_SSE2
+    if (type == 2) {
+        unfilter_up_sse2(cur, src, prev, n);
+        return;
+    }
+    if (bpp == 4 && unfilter_pixels_sse2<4>(type, cur, src, prev, n)) return;
+    if (bpp == 3 && unfilter_pixels_sse2<3>(type, cur, src, prev, n)) return;
+#endif
+    unfilter_scalar(type, cur, src, prev, n, bpp);
+}
+
+inline uint32_t read_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+} // namespace
+
+bool decode_png_fast(const uint8_t* data, size_t size, ImageData& out) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (!data || size < 8 + 25 || std::memcmp(data, signature, 8) != 0) return false;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int color_type = -1;
+    bool seen_ihdr = false;
+    // Indices past the PLTE entries read opaque black, as in libpng
+    uint8_t palette[256 * 4];
+    for (int i = 0; i < 256; ++i) {
+        palette[i * 4 + 0] = 0;
+        palette[i * 4 + 1] = 0;
+        palette[i * 4 + 2] = 0;
+        palette[i * 4 + 3] = 255;
+    }
+    uint32_t palette_size = 0;
+    bool has_palette_alpha = false;
+    std::vector<uint8_t> compressed;
+
+    size_t offset = 8;
+    bool seen_iend = false;
+    while (!seen_iend) {
+        if (size - offset < 12) return false;
+        const uint32_t length = read_be32(data + offset);
+        const uint8_t* type = data + offset + 4;
+        const uint8_t* body = data + offset + 8;
+        if (length > size - offset - 12) return false;
+
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            if (length != 13 || seen_ihdr) return false;
+            width = read_be32(body);
+            height = read_be32(body + 4);
+            const int bit_depth = body[8];
+            color_type = body[9];
+            // Only 8-bit, non-interlaced, standard compression/filter method
+            if (bit_depth != 8 || body[10] != 0 || body[11] != 0 || body[12] != 0) return false;
+            if (color_type != 0 && color_type != 2 && color_type != 3 && color_type != 4 && color_type != 6) return false;
+            if (width == 0 || height == 0 || width > (1u << 24) || height > (1u << 24)) return false;
+            seen_ihdr = true;
+        } else if (!seen_ihdr || std::memcmp(type, "CgBI", 4) == 0) {
+            return false;  // Apple's non-standard PNGs are left to stb
+        } else if (std::memcmp(type, "PLTE", 4) == 0) {
+            if (length % 3 != 0 || length / 3 > 256) return false;
+            palette_size = length / 3;
+            for (uint32_t i = 0; i < palette_size; ++i) {
+                palette[i * 4 + 0] = body[i * 3 + 0];
+                palette[i * 4 + 1] = body[i * 3 + 1];
+                palette[i * 4 + 2] = body[i * 3 + 2];
+                palette[i * 4 + 3] = 255;
+            }
+        } else if (std::memcmp(type, "tRNS", 4) == 0) {
+            if (color_type != 3 || length > palette_size) return false;
+            for (uint32_t i = 0; i < length; ++i) palette[i * 4 + 3] = body[i];
+            has_palette_alpha = true;
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            compressed.insert(compressed.end(), body, body + length);
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            seen_iend = true;
+        } else if (!(type[0] & 0x20)) {
+            return false;  // Unknown critical chunk
+        }
+        offset += 12 + static_cast<size_t>(length);
+    }
+    if (!seen_ihdr || compressed.size() < 2) return false;
+    if (color_type == 3 && palette_size == 0) return false;
+
+    // zlib header: deflate, no preset dictionary
+    if ((compressed[0] & 0x0F) != 8 || (compressed[1] & 0x20) != 0 ||
+        ((compressed[0] << 8) | compressed[1]) % 31 != 0) {
+        return false;
+    }
+
+    const int raw_bpp = color_type == 0 ? 1 : color_type == 2 ? 3 : color_type == 3 ? 1 : color_type == 4 ? 2 : 4;
+    const int channels = color_type == 3 ? (has_palette_alpha ? 4 : 3) : raw_bpp;
+    const size_t row_bytes = static_cast<size_t>(width) * raw_bpp;
+    const size_t raw_size = (row_bytes + 1) * height;
+    if (static_cast<uint64_t>(width) * height * channels > (uint64_t(1) << 32)) return false;
+
+    // Padding lets the bit reader load 8 bytes at a time without bounds checks
+    compressed.insert(compressed.end(), Inflater::PADDING, 0);
+    // Every byte of the inflate buffer is written before it is read
+    std::unique_ptr<uint8_t[]> raw(new (std::nothrow) uint8_t[raw_size + 8]);
+    if (!raw) return false;
+
+    // `out` is only assigned once every row has been decoded
+    ImageData image = ImageData::allocate(static_cast<int>(width), static_cast<int>(height), channels);
+    if (!image.is_valid()) return false;
+
+    // Palette images are unfiltered into index rows, then expanded
+    std::vector<uint8_t> index_rows;
+    if (color_type == 3) index_rows.assign(row_bytes * 2, 0);
+    const std::vector<uint8_t> zero_row(row_bytes, 0);
+
+    uint32_t rows_done = 0;
+    bool filter_ok = true;
+    auto unfilter_available = [&](size_t produced) {
+        const uint32_t rows_ready = static_cast<uint32_t>(std::min<size_t>(produced / (row_bytes + 1), height));
+        for (; rows_done < rows_ready; ++rows_done) {
+            const uint8_t* src = raw.get() + static_cast<size_t>(rows_done) * (row_bytes + 1);
+            const int filter = src[0];
+            if (filter > 4) {
+                filter_ok = false;
+                return;
+            }
+            if (color_type == 3) {
+                uint8_t* cur = index_rows.data() + (rows_done & 1) * row_bytes;
+                const uint8_t* prev = rows_done ? index_rows.data() + ((rows_done - 1) & 1) * row_bytes : zero_row.data();
+                unfilter_row(filter, cur, src + 1, prev, row_bytes, 1);
+                uint8_t* dst = image.row(static_cast<int>(rows_done));
+                for (uint32_t x = 0; x < width; ++x) {
+                    std::memcpy(dst + static_cast<size_t>(x) * channels, palette + cur[x] * 4, static_cast<size_t>(channels));
+                }
+            } else {
+                uint8_t* cur = image.row(static_cast<int>(rows_done));
+                const uint8_t* prev = rows_done ? cur - image.stride : zero_row.data();
+                unfilter_row(filter, cur, src + 1, prev, row_bytes, raw_bpp);
+            }
+        }
+    };
+
+    Inflater inflater(compressed.data() + 2, compressed.size() - 2 - Inflater::PADDING, raw.get(), raw_size);
+    if (!inflater.run(unfilter_available)) return false;
+    unfilter_available(inflater.produced());
+
+    if (!filter_ok || rows_done != height) return false;
+    out = std::move(image);
+    return true;
+}
+
+} // namespace fbiu
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "image_processor.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace fbiu {
+
+// Fast PNG decoder for the common case of the batch inputs:
+// 8-bit gray / gray+alpha / RGB / RGBA / palette, non-interlaced.
+//
+// - Inflate uses an 11-bit lookup table whose entries decode up to two
+//   literals at once, with a canonical slow path only for long codes.
+// - Scanlines are unfiltered while inflate is still running (every 64 KiB
+//   of output), so rows are unfiltered while they are still in cache.
+// - Sub/Up/Average/Paeth unfilters have SSE2 versions for 3 and 4 bytes per
+//   pixel (the serial dependency of these filters leaves nothing for wider
+//   AVX2 registers to gain); other layouts use the scalar loops.
+//
+// The output matches stb_image (same channel count, palette expansion to
+// RGB or RGBA when tRNS is present). Returns false for anything outside the
+// supported subset (16-bit, interlaced, tRNS on non-palette images, ...);
+// the caller then falls back to stb_image. `out` is left untouched unless
+// the whole image decoded.
+bool decode_png_fast(const uint8_t* data, size_t size, ImageData& out);
+
+} // namespace fbiu
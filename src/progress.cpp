@@ -0,0 +1,44 @@
+#include "progress.h"
+
+namespace fbiu {
+
+ProgressReporter::ProgressReporter(const BatchProgress& progress, std::chrono::milliseconds interval, Render render)
+    : progress(progress),
+      interval(interval),
+      render(std::move(render)),
+      start(std::chrono::steady_clock::now()),
+      thread(&ProgressReporter::run, this) {}
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+void ProgressReporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+    render(sample(true));
+}
+
+ProgressReporter::Sample ProgressReporter::sample(bool final) const {
+    Sample s;
+    s.completed = progress.completed.load(std::memory_order_relaxed);
+    s.total = progress.total.load(std::memory_order_relaxed);
+    s.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    s.files_per_second = s.elapsed_seconds > 0.0 ? s.completed / s.elapsed_seconds : 0.0;
+    s.final = final;
+    return s;
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!condition.wait_for(lock, interval, [this] { return stopping; })) {
+        render(sample(false));
+    }
+}
+
+} // namespace fbiu
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace fbiu {
+
+// Counters of a running batch (BatchOptions::progress). Workers publish with
+// relaxed atomic increments; nothing is formatted or locked per file. A
+// display samples the counters at its own pace (ProgressReporter, GUI timer).
+struct BatchProgress {
+    std::atomic<int> completed{0};  // Files finished (written, failed or taken by another process)
+    std::atomic<int> total{0};      // Files queued so far (grows in watch mode)
+};
+
+// Samples a BatchProgress on its own thread every `interval` and passes the
+// snapshot to `render`. stop() (or the destructor) renders a last sample
+// with `final` set, so the display always ends on the true totals.
+class ProgressReporter {
+public:
+    struct Sample {
+        int completed = 0;
+        int total = 0;
+        double elapsed_seconds = 0.0;
+        double files_per_second = 0.0;  // Average since the reporter started
+        bool final = false;
+    };
+    using Render = std::function<void(const Sample&)>;
+
+    ProgressReporter(const BatchProgress& progress, std::chrono::milliseconds interval, Render render);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    void stop();
+
+private:
+    Sample sample(bool final) const;
+    void run();
+
+    const BatchProgress& progress;
+    std::chrono::milliseconds interval;
+    Render render;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+    std::thread thread;
+};
+
+} // namespace fbiu
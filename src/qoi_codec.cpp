@@ -0,0 +1,227 @@
+#include "qoi_codec.h"
+
+#include <cstring>
+
+namespace fbiu {
+
+namespace {
+
+constexpr uint8_t OP_INDEX = 0x00;
+constexpr uint8_t OP_DIFF = 0x40;
+constexpr uint8_t OP_LUMA = 0x80;
+constexpr uint8_t OP_RUN = 0xC0;
+constexpr uint8_t OP_RGB = 0xFE;
+constexpr uint8_t OP_RGBA = 0xFF;
+constexpr uint8_t OP_MASK = 0xC0;
+
+constexpr size_t HEADER_SIZE = 14;
+constexpr uint8_t END_MARKER[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+struct Rgba {
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+    uint8_t a = 0;
+
+    bool operator==(const Rgba& other) const {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+};
+
+inline int hash(const Rgba& px) {
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+inline void write_be32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+inline uint32_t read_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline Rgba load_pixel(const uint8_t* p, int channels) {
+    Rgba px;
+    switch (channels) {
+        case 1: px = {p[0], p[0], p[0], 255}; break;
+        case 2: px = {p[0], p[0], p[0], p[1]}; break;
+        case 3: px = {p[0], p[1], p[2], 255}; break;
+        default: px = {p[0], p[1], p[2], p[3]}; break;
+    }
+    return px;
+}
+
+} // namespace
+
+bool is_qoi(const uint8_t* data, size_t size) {
+    return data && size >= 4 && std::memcmp(data, "qoif", 4) == 0;
+}
+
+bool encode_qoi(const ImageData& image, std::vector<uint8_t>& out) {
+    out.clear();
+    if (!image.is_valid() || image.channels > 4) return false;
+
+    const size_t pixel_count = static_cast<size_t>(image.width) * image.height;
+    if (pixel_count > QOI_MAX_PIXELS) return false;
+    const int channels = image.channels;
+    const int out_channels = (channels == 2 || channels == 4) ? 4 : 3;
+
+    // Worst case: one RGBA op (5 bytes) per pixel
+    out.resize(HEADER_SIZE + pixel_count * (out_channels + 1) + sizeof(END_MARKER));
+    uint8_t* p = out.data();
+    std::memcpy(p, "qoif", 4);
+    write_be32(p + 4, static_cast<uint32_t>(image.width));
+    write_be32(p + 8, static_cast<uint32_t>(image.height));
+    p[12] = static_cast<uint8_t>(out_channels);
+    p[13] = 0;  // sRGB with linear alpha
+    p += HEADER_SIZE;
+
+    Rgba index[64] = {};
+    Rgba prev{0, 0, 0, 255};
+    int run = 0;
+    const uint8_t* src = image.row(0);
+    int x = 0;
+    int y = 0;
+
+    for (size_t i = 0; i < pixel_count; ++i) {
+        const Rgba px = load_pixel(src, channels);
+        src += channels;
+        if (++x == image.width && ++y < image.height) {
+            x = 0;
+            src = image.row(y);
+        }
+
+        if (px == prev) {
+            if (++run == 62 || i + 1 == pixel_count) {
+                *p++ = static_cast<uint8_t>(OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *p++ = static_cast<uint8_t>(OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const int slot = hash(px);
+        if (index[slot] == px) {
+            *p++ = static_cast<uint8_t>(OP_INDEX | slot);
+        } else {
+            index[slot] = px;
+            if (px.a == prev.a) {
+                const int8_t vr = static_cast<int8_t>(px.r - prev.r);
+                const int8_t vg = static_cast<int8_t>(px.g - prev.g);
+                const int8_t vb = static_cast<int8_t>(px.b - prev.b);
+                const int8_t vg_r = static_cast<int8_t>(vr - vg);
+                const int8_t vg_b = static_cast<int8_t>(vb - vg);
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    *p++ = static_cast<uint8_t>(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    *p++ = static_cast<uint8_t>(OP_LUMA | (vg + 32));
+                    *p++ = static_cast<uint8_t>((vg_r + 8) << 4 | (vg_b + 8));
+                } else {
+                    *p++ = OP_RGB;
+                    *p++ = px.r;
+                    *p++ = px.g;
+                    *p++ = px.b;
+                }
+            } else {
+                *p++ = OP_RGBA;
+                *p++ = px.r;
+                *p++ = px.g;
+                *p++ = px.b;
+                *p++ = px.a;
+            }
+        }
+        prev = px;
+    }
+
+    std::memcpy(p, END_MARKER, sizeof(END_MARKER));
+    p += sizeof(END_MARKER);
+    out.resize(static_cast<size_t>(p - out.data()));
+    return true;
+}
+
+bool decode_qoi(const uint8_t* data, size_t size, ImageData& out) {
+    if (!is_qoi(data, size) || size < HEADER_SIZE + sizeof(END_MARKER)) return false;
+
+    const uint32_t width = read_be32(data + 4);
+    const uint32_t height = read_be32(data + 8);
+    const int channels = data[12];
+    if (width == 0 || height == 0 || (channels != 3 && channels != 4) || data[13] > 1) return false;
+    const uint64_t pixel_count = static_cast<uint64_t>(width) * height;
+    if (pixel_count > QOI_MAX_PIXELS) return false;
+
+    out = ImageData::allocate(static_cast<int>(width), static_cast<int>(height), channels);
+    if (!out.is_valid()) return false;
+
+    Rgba index[64] = {};
+    Rgba px{0, 0, 0, 255};
+    int run = 0;
+    const uint8_t* p = data + HEADER_SIZE;
+    // Every op is at most 5 bytes; the end marker must remain after the last one
+    const uint8_t* chunks_end = data + size - sizeof(END_MARKER);
+    uint8_t* dst = out.row(0);
+    uint32_t x = 0;
+    uint32_t y = 0;
+
+    for (uint64_t i = 0; i < pixel_count; ++i) {
+        if (run > 0) {
+            --run;
+        } else {
+            if (p >= chunks_end) {
+                out = ImageData{};
+                return false;
+            }
+            const uint8_t op = *p++;
+            if (op == OP_RGB || op == OP_RGBA) {
+                const size_t bytes = op == OP_RGB ? 3 : 4;
+                if (static_cast<size_t>(chunks_end - p) < bytes) {
+                    out = ImageData{};
+                    return false;
+                }
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                if (op == OP_RGBA) px.a = p[3];
+                p += bytes;
+            } else if ((op & OP_MASK) == OP_INDEX) {
+                px = index[op];
+            } else if ((op & OP_MASK) == OP_DIFF) {
+                px.r = static_cast<uint8_t>(px.r + ((op >> 4) & 3) - 2);
+                px.g = static_cast<uint8_t>(px.g + ((op >> 2) & 3) - 2);
+                px.b = static_cast<uint8_t>(px.b + (op & 3) - 2);
+            } else if ((op & OP_MASK) == OP_LUMA) {
+                if (p >= chunks_end) {
+                    out = ImageData{};
+                    return false;
+                }
+                const int vg = (op & 0x3F) - 32;
+                const uint8_t second = *p++;
+                px.r = static_cast<uint8_t>(px.r + vg - 8 + (second >> 4));
+                px.g = static_cast<uint8_t>(px.g + vg);
+                px.b = static_cast<uint8_t>(px.b + vg - 8 + (second & 0x0F));
+            } else {
+                run = op & 0x3F;
+            }
+            index[hash(px)] = px;
+        }
+
+        dst[0] = px.r;
+        dst[1] = px.g;
+        dst[2] = px.b;
+        if (channels == 4) dst[3] = px.a;
+        dst += channels;
+        if (++x == width && ++y < height) {
+            x = 0;
+            dst = out.row(static_cast<int>(y));
+        }
+    }
+    return true;
+}
+
+} // namespace fbiu
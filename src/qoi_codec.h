@@ -0,0 +1,31 @@
+#pragma once
+
+#include "image_processor.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace fbiu {
+
+// QOI ("Quite OK Image") codec, https://qoiformat.org/qoi-specification.pdf
+//
+// A single-pass, byte-oriented lossless format: several times faster to
+// encode than deflate-based PNG, at comparable size for flat line art.
+// QOI stores 3 or 4 channels only, so gray and gray+alpha images are
+// written as RGB and RGBA.
+
+// Upper bound on width * height from the specification (guards against
+// hostile headers)
+constexpr uint64_t QOI_MAX_PIXELS = 400000000;
+
+// True if `data` starts with the QOI magic ("qoif")
+bool is_qoi(const uint8_t* data, size_t size);
+
+// Replaces the contents of `out`; false for invalid images
+bool encode_qoi(const ImageData& image, std::vector<uint8_t>& out);
+
+// False if the stream is not a complete, valid QOI image
+bool decode_qoi(const uint8_t* data, size_t size, ImageData& out);
+
+} // namespace fbiu
@@ -0,0 +1,84 @@
+#include "raw_format.h"
+
+#include <cstring>
+
+namespace fbiu {
+
+namespace {
+
+constexpr uint8_t MAGIC[8] = {'F', 'B', 'R', 'A', 'W', 0, 0, 1};
+
+inline void write_le32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline void write_le64(uint8_t* p, uint64_t value) {
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline uint32_t read_le32(const uint8_t* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+inline uint64_t read_le64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+} // namespace
+
+bool is_raw_image(const uint8_t* data, size_t size) {
+    return data && size >= sizeof(MAGIC) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool encode_raw(const ImageData& image, std::vector<uint8_t>& out) {
+    out.clear();
+    if (!image.is_valid() || image.channels > 4) return false;
+
+    // Rows are stored tightly packed whatever the stride in memory
+    const size_t stride = image.row_bytes();
+    out.resize(RAW_DATA_OFFSET + stride * image.height);
+    std::memset(out.data(), 0, RAW_DATA_OFFSET);
+    std::memcpy(out.data(), MAGIC, sizeof(MAGIC));
+    write_le32(out.data() + 8, static_cast<uint32_t>(image.width));
+    write_le32(out.data() + 12, static_cast<uint32_t>(image.height));
+    write_le32(out.data() + 16, static_cast<uint32_t>(image.channels));
+    write_le32(out.data() + 20, static_cast<uint32_t>(stride));
+    write_le64(out.data() + 24, RAW_DATA_OFFSET);
+    for (int y = 0; y < image.height; ++y) {
+        std::memcpy(out.data() + RAW_DATA_OFFSET + stride * y, image.row(y), stride);
+    }
+    return true;
+}
+
+bool decode_raw(const uint8_t* data, size_t size, ImageData& out) {
+    if (!is_raw_image(data, size) || size < 32) return false;
+
+    const uint32_t width = read_le32(data + 8);
+    const uint32_t height = read_le32(data + 12);
+    const uint32_t channels = read_le32(data + 16);
+    const uint32_t stride = read_le32(data + 20);
+    const uint64_t offset = read_le64(data + 24);
+    if (width == 0 || height == 0 || width > RAW_MAX_DIMENSION || height > RAW_MAX_DIMENSION ||
+        channels < 1 || channels > 4) {
+        return false;
+    }
+    const size_t row_bytes = static_cast<size_t>(width) * channels;
+    if (stride < row_bytes || offset < 32 || offset > size ||
+        (size - offset) / stride < height - 1 || size - offset - static_cast<uint64_t>(stride) * (height - 1) < row_bytes) {
+        return false;
+    }
+
+    out = ImageData::allocate(static_cast<int>(width), static_cast<int>(height), static_cast<int>(channels));
+    if (!out.is_valid()) return false;
+    const uint8_t* src = data + offset;
+    for (uint32_t y = 0; y < height; ++y) {
+        std::memcpy(out.row(static_cast<int>(y)), src + static_cast<size_t>(stride) * y, row_bytes);
+    }
+    return true;
+}
+
+} // namespace fbiu
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "image_processor.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace fbiu {
+
+// Uncompressed ".fbraw" images for intermediate files.
+//
+// Layout (all integers little-endian):
+//   0   char[8]  magic "FBRAW\0\0\1" (last byte = format version)
+//   8   uint32   width
+//   12  uint32   height
+//   16  uint32   channels (1-4, interleaved 8-bit samples)
+//   20  uint32   row stride in bytes (width * channels)
+//   24  uint64   offset of the first pixel row (RAW_DATA_OFFSET)
+//   32  ...      zero padding up to the data offset
+//
+// Pixel rows start on a 4 KiB boundary, so a reader can mmap the file and
+// use the pixels in place (or read them with O_DIRECT) without copying.
+constexpr size_t RAW_DATA_OFFSET = 4096;
+
+// Largest width or height a reader accepts (guards against hostile headers)
+constexpr uint32_t RAW_MAX_DIMENSION = 1u << 24;
+
+// True if `data` starts with the .fbraw magic
+bool is_raw_image(const uint8_t* data, size_t size);
+
+// Replaces the contents of `out`; false for invalid images
+bool encode_raw(const ImageData& image, std::vector<uint8_t>& out);
+
+// False if the header is invalid or the file is truncated
+bool decode_raw(const uint8_t* data, size_t size, ImageData& out);
+
+} // namespace fbiu
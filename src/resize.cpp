@@ -0,0 +1,215 @@
+#include "resize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FBIU_RESIZE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace fbiu {
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+// Source taps of every output coordinate along one axis: output o reads
+// index[offset[o], offset[o + 1]) with the matching weights (summing to 1)
+struct Taps {
+    std::vector<int> offset;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+double lanczos3(double x) {
+    if (x == 0.0) return 1.0;
+    if (x <= -3.0 || x >= 3.0) return 0.0;
+    const double px = PI * x;
+    return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+}
+
+Taps make_taps(int in_size, int out_size, ResizeFilter filter) {
+    Taps taps;
+    taps.offset.reserve(out_size + 1);
+    taps.offset.push_back(0);
+    const double scale = static_cast<double>(in_size) / out_size;
+    std::vector<double> weights;
+    for (int o = 0; o < out_size; ++o) {
+        // Output pixel o covers [lo, hi) in source pixel coordinates
+        const double lo = o * scale;
+        const double hi = (o + 1) * scale;
+        weights.clear();
+        if (filter == ResizeFilter::BOX) {
+            for (int i = static_cast<int>(std::floor(lo)); i < static_cast<int>(std::ceil(hi)); ++i) {
+                const double w = std::min(hi, i + 1.0) - std::max(lo, static_cast<double>(i));
+                if (w <= 0.0) continue;
+                taps.index.push_back(std::clamp(i, 0, in_size - 1));
+                weights.push_back(w);
+            }
+        } else {
+            // When downscaling the kernel is stretched over the source pixels
+            // one output pixel spans; taps past the edges repeat the edge pixel
+            const double stretch = std::max(scale, 1.0);
+            const double center = (lo + hi) / 2.0;
+            const int begin = static_cast<int>(std::floor(center - 3.0 * stretch));
+            const int end = static_cast<int>(std::ceil(center + 3.0 * stretch));
+            for (int i = begin; i <= end; ++i) {
+                const double w = lanczos3((i + 0.5 - center) / stretch);
+                if (w == 0.0) continue;
+                taps.index.push_back(std::clamp(i, 0, in_size - 1));
+                weights.push_back(w);
+            }
+        }
+        double total = 0.0;
+        for (double w : weights) total += w;
+        for (double w : weights) taps.weight.push_back(static_cast<float>(w / total));
+        taps.offset.push_back(static_cast<int>(taps.index.size()));
+    }
+    return taps;
+}
+
+inline uint8_t to_byte(float value) {
+    return static_cast<uint8_t>(std::lrint(std::clamp(value, 0.0f, 255.0f)));
+}
+
+#ifdef FBIU_RESIZE_SSE2
+
+inline __m128 load_rgba(const uint8_t* p) {
+    int32_t value;
+    std::memcpy(&value, p, 4);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero), zero);
+    return _mm_cvtepi32_ps(wide);
+}
+
+// acc += weight * (r*a, g*a, b*a, a) for each pixel
+void accumulate_rgba_sse2(float* acc, const uint8_t* src, int width, float weight) {
+    const __m128 w = _mm_set1_ps(weight);
+    const __m128 alpha_lane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 alpha_one = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+    for (int x = 0; x < width; ++x) {
+        const __m128 pixel = load_rgba(src + 4 * x);
+        __m128 factor = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+        factor = _mm_mul_ps(_mm_or_ps(_mm_andnot_ps(alpha_lane, factor), alpha_one), w);
+        _mm_storeu_ps(acc + 4 * x, _mm_add_ps(_mm_loadu_ps(acc + 4 * x), _mm_mul_ps(pixel, factor)));
+    }
+}
+
+void filter_row_rgba_sse2(uint8_t* dst, const float* acc, const Taps& columns, int width) {
+    const __m128 alpha_lane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(255.0f);
+    for (int x = 0; x < width; ++x) {
+        __m128 sum = zero;
+        for (int t = columns.offset[x]; t < columns.offset[x + 1]; ++t) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(acc + 4 * columns.index[t]), _mm_set1_ps(columns.weight[t])));
+        }
+
+        // Back to straight alpha; an (almost) transparent result is 0,0,0,0
+        const float alpha = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3)));
+        if (alpha < 0.5f) {
+            std::memset(dst + 4 * x, 0, 4);
+            continue;
+        }
+        const __m128 colour = _mm_mul_ps(sum, _mm_set1_ps(1.0f / alpha));
+        __m128 pixel = _mm_or_ps(_mm_andnot_ps(alpha_lane, colour), _mm_and_ps(alpha_lane, sum));
+        pixel = _mm_min_ps(_mm_max_ps(pixel, zero), max);
+        const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(pixel), _mm_setzero_si128());
+        const int32_t value = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        std::memcpy(dst + 4 * x, &value, 4);
+    }
+}
+
+#endif
+
+// acc += weight * row, with colour premultiplied by alpha when there is one
+void accumulate_row(float* acc, const uint8_t* src, int width, int channels, float weight) {
+#ifdef FBIU_RESIZE_SSE2
+    if (channels == 4) {
+        accumulate_rgba_sse2(acc, src, width, weight);
+        return;
+    }
+#endif
+    if (channels == 1 || channels == 3) {
+        const size_t count = static_cast<size_t>(width) * channels;
+        for (size_t i = 0; i < count; ++i) acc[i] += weight * src[i];
+        return;
+    }
+    const int alpha = channels - 1;
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* pixel = src + x * channels;
+        float* sum = acc + x * channels;
+        const float a = weight * pixel[alpha];
+        for (int c = 0; c < alpha; ++c) sum[c] += a * pixel[c];
+        sum[alpha] += a;
+    }
+}
+
+// Horizontal pass over one accumulated row, then back to straight alpha
+void filter_row(uint8_t* dst, const float* acc, const Taps& columns, int width, int channels) {
+#ifdef FBIU_RESIZE_SSE2
+    if (channels == 4) {
+        filter_row_rgba_sse2(dst, acc, columns, width);
+        return;
+    }
+#endif
+    const int alpha = (channels == 2 || channels == 4) ? channels - 1 : -1;
+    for (int x = 0; x < width; ++x) {
+        float sum[4] = {};
+        for (int t = columns.offset[x]; t < columns.offset[x + 1]; ++t) {
+            const float* pixel = acc + columns.index[t] * channels;
+            for (int c = 0; c < channels; ++c) sum[c] += columns.weight[t] * pixel[c];
+        }
+        uint8_t* out = dst + x * channels;
+        if (alpha >= 0) {
+            if (sum[alpha] < 0.5f) {
+                std::memset(out, 0, channels);
+                continue;
+            }
+            for (int c = 0; c < alpha; ++c) sum[c] /= sum[alpha];
+        }
+        for (int c = 0; c < channels; ++c) out[c] = to_byte(sum[c]);
+    }
+}
+
+} // namespace
+
+bool parse_resize_filter(const std::string& name, ResizeFilter& out) {
+    if (name == "box") {
+        out = ResizeFilter::BOX;
+    } else if (name == "lanczos") {
+        out = ResizeFilter::LANCZOS3;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* resize_filter_name(ResizeFilter filter) {
+    return filter == ResizeFilter::LANCZOS3 ? "lanczos" : "box";
+}
+
+ImageData resize_image(const ImageData& input, int width, int height, ResizeFilter filter) {
+    if (!input.is_valid() || width <= 0 || height <= 0) return ImageData{};
+    ImageData output = ImageData::allocate(width, height, input.channels);
+    if (!output.is_valid()) return output;
+
+    const Taps rows = make_taps(input.height, height, filter);
+    const Taps columns = make_taps(input.width, width, filter);
+
+    // Vertical pass into one float row, horizontal pass straight to the output
+    std::vector<float> acc(input.row_bytes());
+    for (int y = 0; y < height; ++y) {
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int t = rows.offset[y]; t < rows.offset[y + 1]; ++t) {
+            accumulate_row(acc.data(), input.row(rows.index[t]), input.width, input.channels, rows.weight[t]);
+        }
+        filter_row(output.row(y), acc.data(), columns, width, input.channels);
+    }
+    return output;
+}
+
+} // namespace fbiu
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "image_data.h"
+
+#include <string>
+
+namespace fbiu {
+
+// Resampling filter for resize_image()
+enum class ResizeFilter {
+    BOX,      // Area average: each output pixel is the mean of the source
+              // pixels it covers (fast, no ringing)
+    LANCZOS3  // Windowed sinc with 3 lobes, widened when downscaling
+              // (sharper, may ring slightly at hard edges)
+};
+
+// Parse "box" / "lanczos"
+bool parse_resize_filter(const std::string& name, ResizeFilter& out);
+const char* resize_filter_name(ResizeFilter filter);
+
+// Resample to width x height. The filter is applied separably, vertically
+// and then horizontally, in float. Images with alpha (2 or 4 channels) are
+// filtered with premultiplied colour, so fully transparent pixels do not
+// bleed their (arbitrary) colour into visible neighbours. Returns an empty
+// image on invalid input or dimensions.
+ImageData resize_image(const ImageData& input, int width, int height, ResizeFilter filter);
+
+} // namespace fbiu
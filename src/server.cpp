@@ -0,0 +1,589 @@
+#include "server.h"
+#include "batch_engine.h"
+
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace fbiu {
+
+// ---- Protocol helpers ----
+
+static std::string escape_value(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\t') out += "\\t";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+static std::string unescape_value(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char next = value[++i];
+            out += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            out += value[i];
+        }
+    }
+    return out;
+}
+
+// "CMD\tkey=value\t..." -> command and fields
+static std::string parse_line(const std::string& line, std::map<std::string, std::string>& fields) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        parts.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos) break;
+        start = tab + 1;
+    }
+    for (size_t i = 1; i < parts.size(); ++i) {
+        size_t eq = parts[i].find('=');
+        if (eq == std::string::npos) continue;
+        fields[parts[i].substr(0, eq)] = unescape_value(parts[i].substr(eq + 1));
+    }
+    return parts.empty() ? std::string() : parts[0];
+}
+
+static std::string format_line(const std::string& command, const std::map<std::string, std::string>& fields) {
+    std::string line = command;
+    for (const auto& [key, value] : fields) {
+        line += '\t' + key + '=' + escape_value(value);
+    }
+    return line;
+}
+
+static std::string error_reply(const std::string& message) {
+    return format_line("ERR", {{"message", message}});
+}
+
+#ifndef _WIN32
+
+// SOCK_CLOEXEC, accept4 and MSG_NOSIGNAL are not available everywhere
+// (macOS), so sockets are set up with fcntl and SO_NOSIGPIPE instead
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+static void prepare_socket(int fd) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+#endif
+
+std::string default_server_socket_path() {
+    if (const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR")) {
+        if (*runtime_dir) return std::string(runtime_dir) + "/fbiu.sock";
+    }
+#ifndef _WIN32
+    return "/tmp/fbiu-" + std::to_string(getuid()) + ".sock";
+#else
+    return "fbiu.sock";
+#endif
+}
+
+// ---- Server ----
+
+// Finished jobs remembered for STATUS queries
+constexpr size_t MAX_KEPT_JOBS = 256;
+
+// A client whose unfinished request line or unread replies grow past this
+// is disconnected
+constexpr size_t MAX_CLIENT_BUFFER = 1 << 20;
+
+struct BatchServer::Job {
+    ImageProcessor::BatchOptions options;
+    std::atomic<bool> cancel{false};
+    std::atomic<int> completed{0};
+    std::atomic<int> total{0};
+    std::atomic<int> state{0};  // index into STATE_NAMES
+    std::thread worker;
+
+    static constexpr const char* STATE_NAMES[] = {"queued", "running", "done", "failed", "cancelled"};
+};
+
+BatchServer::BatchServer(int num_threads, int io_queue_depth, bool pin_threads)
+    : engine(std::make_unique<BatchEngine>(num_threads, io_queue_depth, pin_threads)) {}
+
+BatchServer::~BatchServer() {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        for (auto& [id, job] : jobs) job->cancel = true;
+    }
+    for (auto& [id, job] : jobs) {
+        if (job->worker.joinable()) job->worker.join();
+    }
+#ifndef _WIN32
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+#endif
+}
+
+bool BatchServer::listen(const std::string& path) {
+#ifndef _WIN32
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) return false;
+    prepare_socket(listen_fd);
+
+    // Jobs read and write anything the server user can: only that user may
+    // connect, whatever the umask. The mode is set before listen(), so no
+    // connection is accepted while the socket is still open to others.
+    unlink(path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+        ::listen(listen_fd, 64) != 0) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    socket_path = path;
+    return true;
+#else
+    (void)path;
+    std::cerr << "Server mode is not supported on this platform" << std::endl;
+    return false;
+#endif
+}
+
+void BatchServer::run(const std::atomic<bool>& stop_flag) {
+#ifndef _WIN32
+    // Requests are cheap (jobs run on their own threads), so one thread
+    // multiplexes every connection: clients that stay connected to follow a
+    // job never hold up the others. Sockets are non-blocking, with input and
+    // unsent replies buffered per client.
+    struct Client {
+        int fd;
+        std::string input;
+        std::string output;
+    };
+    std::vector<Client> clients;
+    std::vector<pollfd> fds;
+
+    while (!stop_flag) {
+        fds.assign(1, pollfd{listen_fd, POLLIN, 0});
+        for (const Client& client : clients) {
+            fds.push_back(pollfd{client.fd, static_cast<short>(POLLIN | (client.output.empty() ? 0 : POLLOUT)), 0});
+        }
+        if (poll(fds.data(), fds.size(), 200) <= 0) continue;
+
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client& client = clients[i];
+            const short events = fds[i + 1].revents;
+            bool open = (events & (POLLERR | POLLNVAL)) == 0;
+
+            if (open && (events & (POLLIN | POLLHUP))) {
+                char chunk[4096];
+                const ssize_t len = recv(client.fd, chunk, sizeof(chunk), 0);
+                if (len > 0) {
+                    client.input.append(chunk, static_cast<size_t>(len));
+                } else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    open = false;
+                }
+                size_t newline;
+                while ((newline = client.input.find('\n')) != std::string::npos) {
+                    client.output += handle_request(client.input.substr(0, newline)) + "\n";
+                    client.input.erase(0, newline + 1);
+                }
+                if (client.input.size() > MAX_CLIENT_BUFFER || client.output.size() > MAX_CLIENT_BUFFER) open = false;
+            }
+
+            if (open && !client.output.empty()) {
+                const ssize_t sent = send(client.fd, client.output.data(), client.output.size(), SEND_FLAGS);
+                if (sent > 0) {
+                    client.output.erase(0, static_cast<size_t>(sent));
+                } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    open = false;
+                }
+            }
+
+            if (!open) {
+                close(client.fd);
+                client.fd = -1;
+            }
+        }
+        std::erase_if(clients, [](const Client& client) { return client.fd < 0; });
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0) {
+                prepare_socket(fd);
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                clients.push_back(Client{fd, {}, {}});
+            }
+        }
+    }
+    for (const Client& client : clients) close(client.fd);
+#else
+    (void)stop_flag;
+#endif
+}
+
+std::string BatchServer::handle_request(const std::string& line) {
+    std::map<std::string, std::string> fields;
+    const std::string command = parse_line(line, fields);
+
+    if (command == "SUBMIT") return submit(fields);
+
+    if (command == "STATS") {
+        int total_jobs = 0;
+        int active = 0;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            total_jobs = next_job_id - 1;
+            for (const auto& [id, job] : jobs) {
+                if (job->state <= 1) ++active;
+            }
+        }
+        return format_line("OK", {{"threads", std::to_string(engine->thread_count())},
+                                  {"jobs", std::to_string(total_jobs)},
+                                  {"active", std::to_string(active)},
+                                  {"files", std::to_string(files_done.load())}});
+    }
+
+    if (command == "STATUS" || command == "CANCEL") {
+        int id = 0;
+        try {
+            id = std::stoi(fields["job"]);
+        } catch (...) {
+            return error_reply("missing job id");
+        }
+
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return error_reply("unknown job");
+        Job& job = *it->second;
+
+        if (command == "CANCEL") {
+            job.cancel = true;
+            return "OK";
+        }
+        return format_line("OK", {{"job", std::to_string(id)},
+                                  {"state", Job::STATE_NAMES[job.state]},
+                                  {"completed", std::to_string(job.completed.load())},
+                                  {"total", std::to_string(job.total.load())}});
+    }
+
+    return error_reply("unknown command");
+}
+
+std::string BatchServer::submit(const std::map<std::string, std::string>& fields) {
+    auto field = [&](const char* key) {
+        auto it = fields.find(key);
+        return it == fields.end() ? std::string() : it->second;
+    };
+
+    auto job = std::make_unique<Job>();
+    ImageProcessor::BatchOptions& options = job->options;
+    options.input_dir = field("input");
+    options.output_dir = field("output");
+    if (options.input_dir.empty() || options.output_dir.empty()) return error_reply("input and output are required");
+    if (!ImageProcessor::parse_function(field("function"), options.function)) return error_reply("unknown function");
+    options.force_reencode = field("force_reencode") == "1";
+    options.keep_rgba = field("keep_rgba") == "1";
+    options.trim = field("trim") == "1";
+    options.report = field("report") == "1";
+    options.drop_cache = field("drop_cache") == "1";
+    options.resume = field("resume") == "1";
+    options.journal = options.resume || field("journal") == "1";
+    if (!field("output_format").empty() &&
+        !ImageProcessor::parse_output_format(field("output_format"), options.output_format)) {
+        return error_reply("unknown output format");
+    }
+    if (!field("proxies").empty() && !ImageProcessor::parse_proxy_scales(field("proxies"), options.proxy_scales)) {
+        return error_reply("invalid proxy scales");
+    }
+    if (!field("proxy_filter").empty() && !parse_resize_filter(field("proxy_filter"), options.proxy_filter)) {
+        return error_reply("unknown proxy filter");
+    }
+
+    try {
+        if (field("threshold") == "auto") {
+            options.auto_threshold = true;
+        } else if (!field("threshold").empty()) {
+            int threshold = std::stoi(field("threshold"));
+            if (threshold < 0 || threshold > 255) return error_reply("threshold out of range");
+            options.luma_threshold = static_cast<uint8_t>(threshold);
+            options.custom_params.threshold = static_cast<uint8_t>(threshold);
+        }
+        if (!field("coef_r").empty()) options.custom_params.coef_r = std::stof(field("coef_r"));
+        if (!field("coef_g").empty()) options.custom_params.coef_g = std::stof(field("coef_g"));
+        if (!field("coef_b").empty()) options.custom_params.coef_b = std::stof(field("coef_b"));
+        options.custom_params.linear = field("linear") == "1";
+    } catch (...) {
+        return error_reply("invalid parameter");
+    }
+
+    // Extra outputs: target1=<spec>, target2=<spec>, ... (see ImageProcessor::parse_target_spec)
+    for (const auto& [key, value] : fields) {
+        if (key.rfind("target", 0) != 0) continue;
+        ImageProcessor::OutputTarget target = options.main_target();
+        target.output_dir.clear();
+        if (!ImageProcessor::parse_target_spec(value, target) || target.output_dir.empty()) {
+            return error_reply("invalid target");
+        }
+        options.extra_targets.push_back(target);
+    }
+
+    Job* raw = job.get();
+    options.cancel_flag = &raw->cancel;
+    options.progress_callback = [this, raw](int completed, int total, const std::string&) {
+        raw->completed = completed;
+        raw->total = total;
+        ++files_done;
+    };
+
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        id = next_job_id++;
+        jobs[id] = std::move(job);
+        
+        // Forget the oldest finished jobs so a long-lived server stays small
+        for (auto it = jobs.begin(); it != jobs.end() && jobs.size() > MAX_KEPT_JOBS; ) {
+            if (it->second->state >= 2) {
+                if (it->second->worker.joinable()) it->second->worker.join();
+                it = jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Each job feeds the shared engine from its own thread; the engine's
+    // worker pool balances the files of all running jobs.
+    raw->worker = std::thread([this, raw]() {
+        raw->state = 1;
+        bool ok = ImageProcessor::batch_process(raw->options, *engine);
+        raw->state = raw->cancel ? 4 : ok ? 2 : 3;
+        
+        // Idle workers should not hold on to frame memory
+        bool idle = true;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            for (const auto& [other_id, other] : jobs) idle &= other->state >= 2;
+        }
+        if (idle) ImageData::release_cached();
+    });
+
+    return format_line("OK", {{"job", std::to_string(id)}});
+}
+
+// ---- Client ----
+
+ServerClient::~ServerClient() {
+#ifndef _WIN32
+    if (fd >= 0) close(fd);
+#endif
+}
+
+bool ServerClient::connect(const std::string& path) {
+#ifndef _WIN32
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        error = "socket path too long";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0) prepare_socket(fd);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error = std::string("cannot connect to ") + path + ": " + std::strerror(errno);
+        if (fd >= 0) close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+#else
+    (void)path;
+    error = "server mode is not supported on this platform";
+    return false;
+#endif
+}
+
+bool ServerClient::request(const std::string& line, std::map<std::string, std::string>& reply) {
+#ifndef _WIN32
+    if (fd < 0) {
+        error = "not connected";
+        return false;
+    }
+    std::string message = line + "\n";
+    if (send(fd, message.data(), message.size(), SEND_FLAGS) != static_cast<ssize_t>(message.size())) {
+        error = "connection lost";
+        return false;
+    }
+
+    size_t newline;
+    char chunk[4096];
+    while ((newline = pending_input.find('\n')) == std::string::npos) {
+        ssize_t len = recv(fd, chunk, sizeof(chunk), 0);
+        if (len <= 0) {
+            error = "connection lost";
+            return false;
+        }
+        pending_input.append(chunk, static_cast<size_t>(len));
+    }
+    std::string reply_line = pending_input.substr(0, newline);
+    pending_input.erase(0, newline + 1);
+
+    reply.clear();
+    if (parse_line(reply_line, reply) != "OK") {
+        error = reply.count("message") ? reply["message"] : reply_line;
+        return false;
+    }
+    return true;
+#else
+    (void)line;
+    (void)reply;
+    error = "server mode is not supported on this platform";
+    return false;
+#endif
+}
+
+int ServerClient::submit(const ImageProcessor::BatchOptions& options) {
+    auto absolute = [](const std::string& dir) {
+        std::error_code ec;
+        fs::path path = fs::absolute(fs::path(reinterpret_cast<const char8_t*>(dir.c_str())), ec);
+        std::u8string u8path = path.u8string();
+        return std::string(reinterpret_cast<const char*>(u8path.c_str()));
+    };
+
+    std::map<std::string, std::string> fields = {
+        {"function", ImageProcessor::function_name(options.function)},
+        {"input", absolute(options.input_dir)},
+        {"output", absolute(options.output_dir)},
+    };
+    if (options.force_reencode) {
+        fields["force_reencode"] = "1";
+    }
+    if (options.keep_rgba) {
+        fields["keep_rgba"] = "1";
+    }
+    if (options.trim) {
+        fields["trim"] = "1";
+    }
+    if (options.report) {
+        fields["report"] = "1";
+    }
+    if (options.drop_cache) {
+        fields["drop_cache"] = "1";
+    }
+    if (options.resume) {
+        fields["resume"] = "1";
+    } else if (options.journal) {
+        fields["journal"] = "1";
+    }
+    if (options.output_format != OutputFormat::PNG) {
+        fields["output_format"] = ImageProcessor::output_format_name(options.output_format);
+    }
+    if (!options.proxy_scales.empty()) {
+        std::ostringstream scales;
+        for (size_t i = 0; i < options.proxy_scales.size(); ++i) {
+            scales << (i > 0 ? "," : "") << options.proxy_scales[i];
+        }
+        fields["proxies"] = scales.str();
+        fields["proxy_filter"] = resize_filter_name(options.proxy_filter);
+    }
+    if (options.function == ProcessFunction::LUMA_TO_ALPHA_CUSTOM) {
+        std::ostringstream coef_r, coef_g, coef_b;
+        coef_r << options.custom_params.coef_r;
+        coef_g << options.custom_params.coef_g;
+        coef_b << options.custom_params.coef_b;
+        fields["threshold"] = std::to_string(options.custom_params.threshold);
+        fields["coef_r"] = coef_r.str();
+        fields["coef_g"] = coef_g.str();
+        fields["coef_b"] = coef_b.str();
+        if (options.custom_params.linear) {
+            fields["linear"] = "1";
+        }
+    } else {
+        fields["threshold"] = std::to_string(options.luma_threshold);
+    }
+    if (options.auto_threshold) {
+        fields["threshold"] = "auto";
+    }
+
+    for (size_t i = 0; i < options.extra_targets.size(); ++i) {
+        ImageProcessor::OutputTarget target = options.extra_targets[i];
+        target.output_dir = absolute(target.output_dir);
+        fields["target" + std::to_string(i + 1)] = ImageProcessor::format_target_spec(target);
+    }
+
+    std::map<std::string, std::string> reply;
+    if (!request(format_line("SUBMIT", fields), reply)) return -1;
+    try {
+        return std::stoi(reply["job"]);
+    } catch (...) {
+        error = "malformed reply";
+        return -1;
+    }
+}
+
+bool ServerClient::status(int job_id, JobStatus& out) {
+    std::map<std::string, std::string> reply;
+    if (!request(format_line("STATUS", {{"job", std::to_string(job_id)}}), reply)) return false;
+    out.id = job_id;
+    out.state = reply["state"];
+    out.completed = std::atoi(reply["completed"].c_str());
+    out.total = std::atoi(reply["total"].c_str());
+    return true;
+}
+
+bool ServerClient::cancel(int job_id) {
+    std::map<std::string, std::string> reply;
+    return request(format_line("CANCEL", {{"job", std::to_string(job_id)}}), reply);
+}
+
+bool ServerClient::stats(ServerStats& out) {
+    std::map<std::string, std::string> reply;
+    if (!request("STATS", reply)) return false;
+    out.threads = std::atoi(reply["threads"].c_str());
+    out.jobs = std::atoi(reply["jobs"].c_str());
+    out.active = std::atoi(reply["active"].c_str());
+    out.files = std::atoll(reply["files"].c_str());
+    return true;
+}
+
+} // namespace fbiu
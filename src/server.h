@@ -0,0 +1,116 @@
+#pragma once
+
+#include "image_processor.h"
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+namespace fbiu {
+
+class BatchEngine;
+
+// Resident batch server (fbiu_server) and its client.
+//
+// Protocol: one request per line over a Unix domain socket, one reply line
+// per request. Fields are tab-separated "key=value" pairs after the command;
+// tabs, newlines and backslashes in values are escaped as \t, \n and \\.
+//
+//   SUBMIT function=<luma2alpha|luma2alpha_custom|png> input=<dir> output=<dir>
+//          [threshold=<0-255|auto>] [coef_r=<f>] [coef_g=<f>] [coef_b=<f>] [linear=1]
+//          [force_reencode=1] [output_format=<png|qoi|raw>] [keep_rgba=1]
+//          [trim=1] [report=1] [drop_cache=1] [journal=1] [resume=1]
+//          [proxies=<N,N...>]
+//          [proxy_filter=<box|lanczos>] [target1=<spec>] [target2=<spec>] ...
+//                          -> OK job=<id>
+//   STATUS job=<id>        -> OK job=<id> state=<queued|running|done|failed|cancelled>
+//                             completed=<n> total=<n>
+//   CANCEL job=<id>        -> OK
+//   STATS                  -> OK threads=<n> jobs=<n> active=<n> files=<n>
+//                             (threads: workers currently active, which
+//                             changes over time with --threads adaptive)
+//
+// target<N> fields add outputs rendered from the same decode of each input;
+// their spec (ImageProcessor::parse_target_spec) starts from the main
+// output's settings and must give output=<dir>.
+//
+// Failures are answered with "ERR message=<text>".
+
+// $XDG_RUNTIME_DIR/fbiu.sock, or /tmp/fbiu-<uid>.sock
+std::string default_server_socket_path();
+
+struct JobStatus {
+    int id = 0;
+    std::string state;
+    int completed = 0;
+    int total = 0;
+};
+
+struct ServerStats {
+    int threads = 0;
+    int jobs = 0;          // Jobs submitted since start
+    int active = 0;        // Jobs queued or running
+    long long files = 0;   // Files finished since start
+};
+
+class BatchServer {
+public:
+    explicit BatchServer(int num_threads = 0, int io_queue_depth = 0, bool pin_threads = false);
+    ~BatchServer();
+
+    BatchServer(const BatchServer&) = delete;
+    BatchServer& operator=(const BatchServer&) = delete;
+
+    // Bind and listen on `socket_path` (a stale socket file is replaced);
+    // the socket is made accessible to the server's user only (mode 0600)
+    bool listen(const std::string& socket_path);
+
+    // Serve requests until stop_flag is set; running jobs are then cancelled
+    void run(const std::atomic<bool>& stop_flag);
+
+private:
+    struct Job;
+
+    std::string handle_request(const std::string& line);
+    std::string submit(const std::map<std::string, std::string>& fields);
+
+    std::unique_ptr<BatchEngine> engine;
+    std::string socket_path;
+    int listen_fd = -1;
+
+    std::mutex jobs_mutex;
+    std::map<int, std::unique_ptr<Job>> jobs;
+    int next_job_id = 1;
+    std::atomic<long long> files_done{0};
+};
+
+class ServerClient {
+public:
+    ServerClient() = default;
+    ~ServerClient();
+
+    ServerClient(const ServerClient&) = delete;
+    ServerClient& operator=(const ServerClient&) = delete;
+
+    bool connect(const std::string& socket_path);
+
+    // Returns the job id, or -1 on failure (see last_error()).
+    // Paths are made absolute before being sent to the server.
+    int submit(const ImageProcessor::BatchOptions& options);
+    bool status(int job_id, JobStatus& out);
+    bool cancel(int job_id);
+    bool stats(ServerStats& out);
+
+    const std::string& last_error() const { return error; }
+
+private:
+    bool request(const std::string& line, std::map<std::string, std::string>& reply);
+
+    int fd = -1;
+    std::string pending_input;
+    std::string error;
+};
+
+} // namespace fbiu
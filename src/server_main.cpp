@@ -0,0 +1,78 @@
+#include "server.h"
+#include "batch_engine.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <map>
+#include <atomic>
+#include <csignal>
+
+static std::atomic<bool> g_stop_requested{false};
+
+static void handle_stop_signal(int) {
+    g_stop_requested = true;
+}
+
+void print_usage() {
+    std::cout << "Fast Batch Image Utility - Server Mode\n";
+    std::cout << "Usage: fbiu_server [--socket <path>] [--threads <n>] [--io-depth <n>] [--pin-threads]\n";
+    std::cout << "\nOptions:\n";
+    std::cout << "  --socket <path>    Unix domain socket to listen on\n";
+    std::cout << "                     (default: " << fbiu::default_server_socket_path() << ")\n";
+    std::cout << "  --threads <n>      Number of worker threads shared by all jobs (default: auto;\n";
+    std::cout << "                     adaptive = tune workers and I/O depth while running)\n";
+    std::cout << "  --io-depth <n>     Files kept in flight by async I/O (default: 128)\n";
+    std::cout << "  --pin-threads      Pin each worker to a core, spread over the NUMA nodes\n";
+    std::cout << "  --help             Show this help message\n";
+    std::cout << "\nClients: fbiu_cli --server <path> ..., or set FBIU_SERVER for the GUI.\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::map<std::string, std::string> args;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        }
+        
+        if (arg == "--pin-threads") {
+            args.emplace("pin-threads", "1");
+            continue;
+        }
+        
+        if (arg.substr(0, 2) == "--" && i + 1 < argc) {
+            args[arg.substr(2)] = argv[i + 1];
+            ++i;
+        }
+    }
+    
+    int threads = 0;
+    int io_depth = 0;
+    try {
+        if (args.count("threads")) {
+            threads = args["threads"] == "adaptive" ? fbiu::ADAPTIVE_THREADS : std::max(0, std::stoi(args["threads"]));
+        }
+        if (args.count("io-depth")) io_depth = std::stoi(args["io-depth"]);
+    } catch (...) {
+        std::cerr << "Error: Invalid numeric option\n";
+        return 1;
+    }
+    
+    std::string socket_path = args.count("socket") ? args["socket"] : fbiu::default_server_socket_path();
+    
+    fbiu::BatchServer server(threads, io_depth, args.count("pin-threads") > 0);
+    if (!server.listen(socket_path)) {
+        return 1;
+    }
+    
+    std::signal(SIGINT, handle_stop_signal);
+    std::signal(SIGTERM, handle_stop_signal);
+    
+    std::cout << "Listening on " << socket_path << " (Ctrl+C to stop)\n";
+    server.run(g_stop_requested);
+    std::cout << "Server stopped\n";
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "shard.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace fbiu {
+
+uint64_t stable_hash(const std::string& key) {
+    return stable_hash(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+}
+
+uint64_t stable_hash(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool ShardSpec::parse(const std::string& text, ShardSpec& out) {
+    size_t slash = text.find('/');
+    if (slash == std::string::npos) return false;
+    try {
+        const std::string index_text = text.substr(0, slash);
+        const std::string count_text = text.substr(slash + 1);
+        size_t index_end = 0;
+        size_t count_end = 0;
+        int index = std::stoi(index_text, &index_end);
+        int count = std::stoi(count_text, &count_end);
+        if (index_end != index_text.size() || count_end != count_text.size()) return false;
+        if (count <= 0 || index < 0 || index >= count) return false;
+        out.index = index;
+        out.count = count;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool ShardSpec::contains(const std::string& key) const {
+    if (count <= 1) return true;
+    return static_cast<int>(stable_hash(key) % static_cast<uint64_t>(count)) == index;
+}
+
+ClaimDirectory::ClaimDirectory(std::string dir) : dir(std::move(dir)) {
+    fs::path dir_path(reinterpret_cast<const char8_t*>(this->dir.c_str()));
+    std::error_code ec;
+    fs::create_directories(dir_path, ec);
+    valid = fs::is_directory(dir_path, ec);
+}
+
+fs::path ClaimDirectory::path_for(const std::string& key, const char* suffix) const {
+    char name[48];
+    std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(stable_hash(key)), suffix);
+    return fs::path(reinterpret_cast<const char8_t*>(dir.c_str())) / name;
+}
+
+static long current_pid() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return getpid();
+#endif
+}
+
+// "host=H pid=P" for this process (no host on Windows)
+static std::string owner_tag() {
+#ifdef _WIN32
+    return "pid=" + std::to_string(current_pid());
+#else
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    return std::string("host=") + host + " pid=" + std::to_string(current_pid());
+#endif
+}
+
+static std::string read_claim(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+// True if the claim `content` was written by a process on this host that is
+// no longer running. Claims from other hosts are never judged stale.
+static bool owner_gone(const std::string& content) {
+#ifdef _WIN32
+    (void)content;
+    return false;
+#else
+    const std::string own = owner_tag();
+    // The key (a file name) comes first and may itself contain these tags
+    const size_t pid = content.rfind(" pid=");
+    const size_t host = pid == std::string::npos ? pid : content.rfind(" host=", pid);
+    if (host == std::string::npos) return false;
+    if (content.compare(host + 1, pid - host - 1, own, 0, own.find(' ')) != 0) return false;
+    const long owner = std::strtol(content.c_str() + pid + 5, nullptr, 10);
+    if (owner <= 0 || owner == current_pid()) return false;
+    return ::kill(static_cast<pid_t>(owner), 0) != 0 && errno == ESRCH;
+#endif
+}
+
+// Exclusive create of `path` holding `content`; errno tells why it failed
+static bool create_exclusive(const fs::path& path, const std::string& content) {
+#ifdef _WIN32
+    int fd = _wopen(path.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (fd < 0) return false;
+    _write(fd, content.data(), static_cast<unsigned>(content.size()));
+    _close(fd);
+#else
+    int fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    (void)::write(fd, content.data(), content.size());
+    ::close(fd);
+#endif
+    return true;
+}
+
+ClaimDirectory::Result ClaimDirectory::try_claim(const std::string& key) {
+    if (!valid) return Result::FAILED;
+
+    const fs::path claim_path = path_for(key, ".claim");
+    const fs::path done_path = path_for(key, ".done");
+    std::error_code ec;
+    if (fs::exists(done_path, ec)) return Result::TAKEN;
+
+    const std::string owner = key + " " + owner_tag() + "\n";
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        // Exclusive create: fails with EEXIST if another process holds the claim
+        if (create_exclusive(claim_path, owner)) {
+            // The previous owner may have finished between the check and the create
+            if (fs::exists(done_path, ec)) {
+                fs::remove(claim_path, ec);
+                return Result::TAKEN;
+            }
+            return Result::CLAIMED;
+        }
+        const int error = errno;
+        if (error != EEXIST) {
+            std::cerr << "Cannot create claim file in " << dir << ": " << std::strerror(error) << std::endl;
+            return Result::FAILED;
+        }
+
+        const std::string holder = read_claim(claim_path);
+        if (attempt > 0 || !owner_gone(holder)) return Result::TAKEN;
+
+        // Stale claim: move it aside under a name private to this process.
+        // Only one process can move a given file, and if the claim was
+        // replaced after it was read, the live one is put back.
+        fs::path stale_path = claim_path;
+        stale_path += ".stale-" + std::to_string(current_pid());
+        fs::rename(claim_path, stale_path, ec);
+        if (ec) return Result::TAKEN;
+        if (read_claim(stale_path) != holder) {
+            fs::create_hard_link(stale_path, claim_path, ec);
+            fs::remove(stale_path, ec);
+            return Result::TAKEN;
+        }
+        fs::remove(stale_path, ec);
+    }
+    return Result::TAKEN;
+}
+
+void ClaimDirectory::complete(const std::string& key) {
+    std::error_code ec;
+    fs::rename(path_for(key, ".claim"), path_for(key, ".done"), ec);
+    if (ec) std::cerr << "Cannot mark claim done in " << dir << ": " << ec.message() << std::endl;
+}
+
+void ClaimDirectory::release(const std::string& key) {
+    std::error_code ec;
+    fs::remove(path_for(key, ".claim"), ec);
+}
+
+} // namespace fbiu
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace fbiu {
+
+// Stable 64-bit FNV-1a hash. Unlike std::hash the result is identical across
+// processes, hosts and compilers, so every shard agrees on the partitioning.
+uint64_t stable_hash(const std::string& key);
+uint64_t stable_hash(const uint8_t* data, size_t size);
+
+// Deterministic partition of a batch: a file belongs to shard `index` of
+// `count` when stable_hash(file name) % count == index.
+struct ShardSpec {
+    int index = 0;
+    int count = 1;
+
+    // Parse "i/N" (0 <= i < N); nothing may follow N
+    static bool parse(const std::string& text, ShardSpec& out);
+
+    bool contains(const std::string& key) const;
+};
+
+// Shared-directory work claiming. Several processes (possibly on different
+// hosts sharing the directory) call try_claim() before processing a file;
+// exactly one of them succeeds because the claim file is created with
+// exclusive-create semantics. Files are claimed right before they are read,
+// so faster processes naturally take more of the work.
+//
+// A finished file's claim becomes a done marker, so re-running a batch on
+// the same directory only picks up what is left. A failed file's claim is
+// released. A claim left behind by a process that died is taken over once
+// its recorded owner (same host, pid no longer running) is gone.
+class ClaimDirectory {
+public:
+    enum class Result {
+        CLAIMED,  // This process now owns the key
+        TAKEN,    // Another process owns or already finished it
+        FAILED,   // The claim file could not be created (reported on stderr)
+    };
+
+    explicit ClaimDirectory(std::string dir);
+
+    // True when the directory exists (or could be created)
+    bool is_valid() const { return valid; }
+
+    Result try_claim(const std::string& key);
+
+    // Turn an owned claim into a done marker
+    void complete(const std::string& key);
+
+    // Give up an owned claim so another process (or a later run) retries it
+    void release(const std::string& key);
+
+private:
+    // <dir>/<hash of key><suffix>
+    std::filesystem::path path_for(const std::string& key, const char* suffix) const;
+
+    std::string dir;
+    bool valid = false;
+};
+
+} // namespace fbiu
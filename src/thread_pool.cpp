@@ -1,10 +1,15 @@
 ﻿#include "thread_pool.h"
+#include "cpu_topology.h"
+
+#include <algorithm>
+
 namespace fbiu {
 
-ThreadPool::ThreadPool(size_t num_threads) {
+ThreadPool::ThreadPool(size_t num_threads, const std::vector<int>& cpus) {
     for (size_t i = 0; i < num_threads; ++i) {
-        workers.emplace_back(&ThreadPool::worker_thread, this);
+        workers.emplace_back(&ThreadPool::worker_thread, this, cpus.empty() ? -1 : cpus[i % cpus.size()]);
     }
+    limit = workers.size();
 }
 
 ThreadPool::~ThreadPool() {
@@ -21,7 +26,7 @@ ThreadPool::~ThreadPool() {
 void ThreadPool::enqueue(std::function<void()> task) {
     {
         std::lock_guard<std::mutex> lock(queue_mutex);
-        tasks.push(std::move(task));
+        tasks.push({std::move(task), std::chrono::steady_clock::now()});
         queued_tasks++;
     }
     condition.notify_one();
@@ -34,14 +39,24 @@ void ThreadPool::wait() {
     });
 }
 
-void ThreadPool::worker_thread() {
+void ThreadPool::set_active_limit(size_t new_limit) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        limit = std::max<size_t>(1, std::min(new_limit, workers.size()));
+    }
+    condition.notify_all();
+}
+
+void ThreadPool::worker_thread(int cpu) {
+    if (cpu >= 0) pin_current_thread(cpu);
+    
     while (true) {
         std::function<void()> task;
         
         {
             std::unique_lock<std::mutex> lock(queue_mutex);
             condition.wait(lock, [this] {
-                return stop || !tasks.empty();
+                return stop || (!tasks.empty() && static_cast<size_t>(active_tasks) < limit);
             });
             
             if (stop && tasks.empty()) {
@@ -49,7 +64,9 @@ void ThreadPool::worker_thread() {
             }
             
             if (!tasks.empty()) {
-                task = std::move(tasks.front());
+                const auto waited = std::chrono::steady_clock::now() - tasks.front().queued_at;
+                queue_wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+                task = std::move(tasks.front().run);
                 tasks.pop();
                 queued_tasks--;
                 active_tasks++;
@@ -62,6 +79,7 @@ void ThreadPool::worker_thread() {
                 std::lock_guard<std::mutex> lock(queue_mutex);
                 active_tasks--;
             }
+            condition.notify_one();     // A parked worker may now run under the limit
             wait_condition.notify_all(); // 待機中のスレッド(例: wait()内)に通知します
         }
     }
@@ -7,12 +7,16 @@
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 
 namespace fbiu {
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t num_threads);
+    // With `cpus`, worker i pins itself to cpus[i % cpus.size()] before it
+    // takes its first task (see CpuTopology::placement)
+    explicit ThreadPool(size_t num_threads, const std::vector<int>& cpus = {});
     ~ThreadPool();
     
     // Add task to queue
@@ -21,9 +25,25 @@ class ThreadPool {
     // Wait for all tasks to complete
     void wait();
     
+    // Run at most `limit` tasks at once (clamped to 1..size()); the other
+    // workers stay parked. Starts at size().
+    void set_active_limit(size_t limit);
+    size_t active_limit() const { return limit; }
+    size_t size() const { return workers.size(); }
+    
+    // Tasks waiting for a worker, and the total time tasks have spent
+    // waiting so far (for the adaptive controller, see BatchEngine)
+    int queued() const { return queued_tasks; }
+    uint64_t total_queue_wait_ns() const { return queue_wait_ns; }
+    
 private:
+    struct Task {
+        std::function<void()> run;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+    
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    std::queue<Task> tasks;
     
     std::mutex queue_mutex;
     std::condition_variable condition;
@@ -32,8 +52,10 @@ class ThreadPool {
     std::atomic<bool> stop{false};
     std::atomic<int> active_tasks{0};
     std::atomic<int> queued_tasks{0};
+    std::atomic<size_t> limit{0};
+    std::atomic<uint64_t> queue_wait_ns{0};
     
-    void worker_thread();
+    void worker_thread(int cpu);
 };
 
 } // namespace fbiu
@@ -0,0 +1,125 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace fbiu {
+
+namespace {
+
+std::atomic<uint64_t> next_tracer_id{1};
+
+// Last buffer this thread recorded into (per thread, so no lock)
+struct CachedBuffer {
+    uint64_t tracer_id = 0;
+    void* buffer = nullptr;
+};
+thread_local CachedBuffer cached_buffer;
+
+void write_escaped(std::ostream& out, const std::string& text) {
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+}
+
+} // namespace
+
+Tracer::Tracer() : id(next_tracer_id++), origin_ns(now_ns()) {}
+
+Tracer::~Tracer() = default;
+
+int64_t Tracer::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Tracer::ThreadBuffer& Tracer::local_buffer() {
+    if (cached_buffer.tracer_id == id) return *static_cast<ThreadBuffer*>(cached_buffer.buffer);
+
+    // First span of this thread in this tracer (or the thread switched
+    // between tracers): find or register its buffer
+    const std::thread::id thread = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mutex);
+    ThreadBuffer* buffer = nullptr;
+    for (const auto& candidate : buffers) {
+        if (candidate->thread == thread) buffer = candidate.get();
+    }
+    if (!buffer) {
+        buffers.push_back(std::make_unique<ThreadBuffer>(ThreadBuffer{thread, {}}));
+        buffer = buffers.back().get();
+        buffer->events.reserve(1024);
+    }
+    cached_buffer = {id, buffer};
+    return *buffer;
+}
+
+void Tracer::span(const char* name, int64_t start_ns, int64_t end_ns, std::string detail) {
+    local_buffer().events.push_back({name, start_ns, end_ns, std::move(detail), false});
+}
+
+void Tracer::async_span(const char* name, int64_t start_ns, int64_t end_ns, std::string detail) {
+    local_buffer().events.push_back({name, start_ns, end_ns, std::move(detail), true});
+}
+
+bool Tracer::write_json(const std::string& path) const {
+    std::ofstream out(fs::path(reinterpret_cast<const char8_t*>(path.c_str())), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    // Timestamps are microseconds since the tracer was created
+    auto micros = [this](int64_t ns) { return static_cast<double>(ns - origin_ns) / 1000.0; };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"fbiu batch\"}}";
+    out.precision(3);
+    out << std::fixed;
+
+    uint64_t async_id = 0;
+    for (size_t tid = 0; tid < buffers.size(); ++tid) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid + 1
+            << ",\"args\":{\"name\":\"thread " << tid + 1 << "\"}}";
+        for (const Event& event : buffers[tid]->events) {
+            auto write_args = [&]() {
+                if (event.detail.empty()) return;
+                out << ",\"args\":{\"file\":\"";
+                write_escaped(out, event.detail);
+                out << "\"}";
+            };
+            if (event.async) {
+                // Begin/end pair; each span gets its own id so overlapping
+                // waits are laid out side by side
+                ++async_id;
+                out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.name
+                    << "\",\"ph\":\"b\",\"id\":" << async_id << ",\"pid\":1,\"tid\":" << tid + 1
+                    << ",\"ts\":" << micros(event.start_ns);
+                write_args();
+                out << "}";
+                out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.name
+                    << "\",\"ph\":\"e\",\"id\":" << async_id << ",\"pid\":1,\"tid\":" << tid + 1
+                    << ",\"ts\":" << micros(event.end_ns) << "}";
+            } else {
+                out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid + 1
+                    << ",\"ts\":" << micros(event.start_ns) << ",\"dur\":" << micros(event.end_ns) - micros(event.start_ns);
+                write_args();
+                out << "}";
+            }
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace fbiu
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fbiu {
+
+// Span recorder for batch runs, exported as Chrome Trace Event JSON
+// (open in ui.perfetto.dev or chrome://tracing).
+//
+// Every thread appends to its own buffer, so recording a span takes no
+// lock; a thread's buffer is registered under the mutex the first time it
+// records into a tracer. Buffers are only read by write_json(), which must
+// run after the traced work has finished.
+//
+//   span()        work done by the calling thread (decode, kernel, ...);
+//                 shown on that thread's track, nested by time
+//   async_span()  an interval no thread was busy for (waiting in the worker
+//                 queue, I/O in flight); shown on tracks of its own
+class Tracer {
+public:
+    Tracer();
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // Steady clock in nanoseconds (the timestamps spans are given in)
+    static int64_t now_ns();
+
+    // `name` must outlive the tracer (a string literal); `detail` (e.g. the
+    // file name) is shown as an argument of the span
+    void span(const char* name, int64_t start_ns, int64_t end_ns, std::string detail = {});
+    void async_span(const char* name, int64_t start_ns, int64_t end_ns, std::string detail = {});
+
+    bool write_json(const std::string& path) const;
+
+private:
+    struct Event {
+        const char* name;
+        int64_t start_ns;
+        int64_t end_ns;
+        std::string detail;
+        bool async;
+    };
+
+    struct ThreadBuffer {
+        std::thread::id thread;
+        std::vector<Event> events;
+    };
+
+    ThreadBuffer& local_buffer();
+
+    uint64_t id;  // Distinguishes tracers in the per-thread buffer cache
+    int64_t origin_ns;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+// Records its own lifetime as a span of `tracer` (nothing when it is null)
+class TraceSpan {
+public:
+    TraceSpan(Tracer* tracer, const char* name, std::string detail = {})
+        : tracer(tracer), name(name), detail(std::move(detail)), start_ns(tracer ? Tracer::now_ns() : 0) {}
+    ~TraceSpan() {
+        if (tracer) tracer->span(name, start_ns, Tracer::now_ns(), std::move(detail));
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    Tracer* tracer;
+    const char* name;
+    std::string detail;
+    int64_t start_ns;
+};
+
+} // namespace fbiu
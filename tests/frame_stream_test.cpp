@@ -0,0 +1,169 @@
+// Regression checks for FrameReader on hostile stdin: size fields far larger
+// than the stream (4 GB length prefix, 2 GB PNG chunk, oversized .fbraw,
+// 2^40-pixel QOI) must fail the frame without allocating their size, and a
+// truncated QOI must not decode.
+
+#include "frame_stream.h"
+#include "image_processor.h"
+#include "qoi_codec.h"
+#include "raw_format.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace fbiu;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (condition) return;
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++failures;
+}
+
+void write_be32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void put_le32(std::vector<uint8_t>& out, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+// Bytes a frame may hold after a failed read: what the stream had, plus the
+// step read() grows by
+constexpr size_t MAX_PARTIAL = size_t(4) << 20;
+
+// Read the first frame of `stream`; `error` gets the reader's message
+bool read_first(const std::vector<uint8_t>& stream, StreamFraming framing, std::vector<uint8_t>& frame,
+                std::string& error) {
+    std::FILE* in = std::tmpfile();
+    if (!in) return false;
+    std::fwrite(stream.data(), 1, stream.size(), in);
+    std::rewind(in);
+    FrameReader reader(in, framing);
+    const bool ok = reader.next(frame);
+    error = reader.error();
+    std::fclose(in);
+    return ok;
+}
+
+// The frame fails with `expected` in the message and without a large buffer
+void check_rejected(const std::vector<uint8_t>& stream, StreamFraming framing, const char* expected,
+                    const char* what) {
+    std::vector<uint8_t> frame;
+    std::string error;
+    const bool ok = read_first(stream, framing, frame, error);
+    check(!ok, what);
+    check(error.find(expected) != std::string::npos, what);
+    check(frame.capacity() <= MAX_PARTIAL, what);
+    if (error.find(expected) == std::string::npos) std::fprintf(stderr, "  error was: %s\n", error.c_str());
+}
+
+ImageData make_image(int width, int height, int channels) {
+    ImageData image = ImageData::allocate(width, height, channels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width * channels; ++x) image.row(y)[x] = static_cast<uint8_t>(x * 7 + y * 13);
+    }
+    return image;
+}
+
+} // namespace
+
+int main() {
+    const std::vector<uint8_t> payload = {1, 2, 3, 4, 5};
+
+    // Intact length-prefixed frame
+    {
+        std::vector<uint8_t> stream;
+        write_be32(stream, static_cast<uint32_t>(payload.size()));
+        stream.insert(stream.end(), payload.begin(), payload.end());
+        std::vector<uint8_t> frame;
+        std::string error;
+        check(read_first(stream, StreamFraming::LENGTH_PREFIXED, frame, error) && frame == payload,
+              "length-prefixed frame");
+    }
+
+    // 4 GB length prefix over a few bytes of data
+    {
+        std::vector<uint8_t> stream;
+        write_be32(stream, 0xFFFFFFFFu);
+        stream.insert(stream.end(), payload.begin(), payload.end());
+        check_rejected(stream, StreamFraming::LENGTH_PREFIXED, "truncated", "4 GB length prefix");
+    }
+
+    // PNG chunk claiming 2 GB, and one past the PNG limit
+    for (uint32_t length : {0x7FFFFFFFu, 0x80000000u}) {
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        std::vector<uint8_t> stream(signature, signature + 8);
+        write_be32(stream, length);
+        stream.insert(stream.end(), {'I', 'D', 'A', 'T'});
+        stream.insert(stream.end(), payload.begin(), payload.end());
+        check_rejected(stream, StreamFraming::CONCATENATED, length == 0x7FFFFFFFu ? "truncated PNG" : "invalid PNG chunk length",
+                       "2 GB PNG chunk");
+    }
+
+    // .fbraw headers: rows beyond the frame limit, and a height past RAW_MAX_DIMENSION
+    {
+        std::vector<uint8_t> raw;
+        check(encode_raw(make_image(4, 4, 3), raw), "encode .fbraw");
+        std::vector<uint8_t> header(raw.begin(), raw.begin() + 32);
+
+        std::vector<uint8_t> huge_rows = header;
+        put_le32(huge_rows, 12, RAW_MAX_DIMENSION);
+        put_le32(huge_rows, 20, 1u << 20);
+        check_rejected(huge_rows, StreamFraming::CONCATENATED, "frame too large", "oversized .fbraw rows");
+
+        std::vector<uint8_t> tall = header;
+        put_le32(tall, 12, RAW_MAX_DIMENSION + 1);
+        check_rejected(tall, StreamFraming::CONCATENATED, "invalid .fbraw header", "oversized .fbraw height");
+
+        ImageData decoded;
+        check(!decode_raw(huge_rows.data(), huge_rows.size(), decoded) && !decoded.is_valid(), "oversized .fbraw decode");
+    }
+
+    // QOI header of 2^20 x 2^20 = 2^40 pixels
+    {
+        std::vector<uint8_t> stream = {'q', 'o', 'i', 'f'};
+        write_be32(stream, 1u << 20);
+        write_be32(stream, 1u << 20);
+        stream.insert(stream.end(), {4, 0});
+        stream.insert(stream.end(), payload.begin(), payload.end());
+        check_rejected(stream, StreamFraming::CONCATENATED, "invalid QOI header", "2^40-pixel QOI");
+
+        ImageData decoded;
+        check(!decode_qoi(stream.data(), stream.size(), decoded) && !decoded.is_valid(), "2^40-pixel QOI decode");
+    }
+
+    // Truncated QOI: the reader reports it and no cut decodes to an image
+    {
+        std::vector<uint8_t> qoi;
+        check(encode_qoi(make_image(64, 32, 4), qoi), "encode QOI");
+        std::vector<uint8_t> frame;
+        std::string error;
+        check(read_first(qoi, StreamFraming::CONCATENATED, frame, error) && frame == qoi, "intact QOI frame");
+
+        for (size_t keep = 14; keep < qoi.size(); keep += 1 + keep / 16) {
+            std::vector<uint8_t> cut(qoi.begin(), qoi.begin() + keep);
+            cut.shrink_to_fit();
+            check_rejected(cut, StreamFraming::CONCATENATED, "truncated QOI", "truncated QOI stream");
+            ImageData decoded;
+            check(!decode_qoi(cut.data(), cut.size(), decoded) && !decoded.is_valid(), "truncated QOI decode");
+            check(!ImageProcessor::decode_image(cut.data(), cut.size()).is_valid(), "truncated QOI decode_image");
+        }
+    }
+
+    if (failures) {
+        std::fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    std::printf("frame_stream_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Regression checks for decode_png_fast on damaged input: truncated and
+// bit-flipped streams must be rejected (or decode to a well-formed image)
+// without reading outside the input, and decode_image must not hand back a
+// partly decoded frame. Build with -fsanitize=address to catch over-reads.
+
+#include "png_decoder.h"
+#include "image_processor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace fbiu;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what, size_t detail) {
+    if (condition) return;
+    std::fprintf(stderr, "FAIL: %s (%zu)\n", what, detail);
+    ++failures;
+}
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+void write_be32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void append_chunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t size) {
+    write_be32(png, static_cast<uint32_t>(size));
+    const size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + size);
+    write_be32(png, crc32(png.data() + start, png.size() - start));
+}
+
+// Split a PNG into its IHDR payload and the concatenated IDAT stream
+bool split_png(const std::vector<uint8_t>& png, std::vector<uint8_t>& ihdr, std::vector<uint8_t>& idat) {
+    size_t pos = 8;
+    while (pos + 12 <= png.size()) {
+        const uint32_t length = read_be32(&png[pos]);
+        const uint8_t* type = &png[pos + 4];
+        const uint8_t* data = &png[pos + 8];
+        if (pos + 12 + length > png.size()) return false;
+        if (std::equal(type, type + 4, "IHDR")) ihdr.assign(data, data + length);
+        if (std::equal(type, type + 4, "IDAT")) idat.insert(idat.end(), data, data + length);
+        pos += 12 + length;
+    }
+    return !ihdr.empty() && !idat.empty();
+}
+
+// A well-formed PNG (valid chunk lengths and CRCs) around `idat`
+std::vector<uint8_t> build_png(const std::vector<uint8_t>& ihdr, const std::vector<uint8_t>& idat) {
+    static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> png(SIGNATURE, SIGNATURE + 8);
+    append_chunk(png, "IHDR", ihdr.data(), ihdr.size());
+    append_chunk(png, "IDAT", idat.data(), idat.size());
+    append_chunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+// Decode a copy sized exactly to the data, so any over-read is out of bounds
+bool decode(const std::vector<uint8_t>& png, ImageData& out) {
+    std::vector<uint8_t> exact(png);
+    exact.shrink_to_fit();
+    return decode_png_fast(exact.data(), exact.size(), out);
+}
+
+// zlib stream (dynamic Huffman, level 9) of a 32x32 8-bit gray image of
+// sparse noise, every row filter 0. Literal 0 is the most frequent symbol and
+// gets the all-zero code, so after a cut the decoder's zero padding decodes
+// as a long run of literals instead of ending the block (the stb encoder
+// only writes fixed Huffman blocks, where the zero code ends the block).
+const uint8_t SPARSE_GRAY_32[] = {
+    0x78, 0xda, 0x5d, 0x93, 0x7b, 0x4c, 0xce, 0x61, 0x14, 0xc7, 0x3f, 0xa4, 0x3f, 0x68, 0x58, 0xb6,
+    0x12, 0x63, 0x51, 0xb3, 0xa2, 0x59, 0x35, 0x45, 0x9a, 0x5b, 0x17, 0xab, 0xb6, 0xb0, 0xc9, 0x65,
+    0xbc, 0x31, 0x9b, 0x89, 0x56, 0xc9, 0x6d, 0xcc, 0x35, 0x63, 0x93, 0xfc, 0xc1, 0x72, 0x4b, 0xda,
+    0x22, 0x99, 0xc6, 0xf4, 0xaa, 0x61, 0x2d, 0xb3, 0x84, 0x2e, 0x92, 0x35, 0xc9, 0xd2, 0x12, 0xd2,
+    0xeb, 0x36, 0x97, 0x98, 0x35, 0xcc, 0x6c, 0x9c, 0xf3, 0xfc, 0x7e, 0xef, 0x5a, 0xce, 0xde, 0x73,
+    0x9e, 0xf3, 0x3d, 0xe7, 0xbc, 0xcf, 0x73, 0x6e, 0x3f, 0x80, 0x89, 0xdf, 0x40, 0x7e, 0x6c, 0x6f,
+    0x9c, 0x80, 0x0f, 0x7c, 0xa7, 0xa1, 0x13, 0x57, 0x7c, 0xb8, 0x58, 0xce, 0x72, 0x1d, 0xa5, 0x11,
+    0x29, 0x65, 0x91, 0x99, 0x87, 0xe1, 0x27, 0x4f, 0x86, 0x31, 0x8b, 0xd1, 0x62, 0x3a, 0x4a, 0xb1,
+    0xc8, 0xc7, 0xc2, 0xe5, 0xdc, 0xa5, 0x3e, 0xe2, 0x08, 0x3b, 0x5f, 0x15, 0x99, 0xe0, 0x78, 0x7a,
+    0x39, 0xea, 0xc5, 0xb0, 0xfd, 0x67, 0x70, 0xd3, 0xf0, 0x38, 0xd8, 0x85, 0xde, 0xd8, 0xbd, 0x8c,
+    0xec, 0x77, 0x78, 0xc3, 0x2a, 0x67, 0x48, 0x85, 0xe0, 0x2f, 0xc6, 0xbf, 0x08, 0x5e, 0xb2, 0x19,
+    0x4e, 0x10, 0x70, 0x5c, 0xe0, 0xba, 0x2e, 0x58, 0x6e, 0x1c, 0xd1, 0xd0, 0xe7, 0xaf, 0x8a, 0xc0,
+    0x18, 0x0f, 0x39, 0x73, 0x8c, 0x79, 0x9e, 0x8a, 0xdf, 0xc2, 0xd6, 0x8b, 0xf7, 0x70, 0x88, 0xf0,
+    0xed, 0xa2, 0x84, 0x4f, 0x8a, 0xb7, 0x70, 0x89, 0x43, 0xd4, 0x96, 0x1a, 0xa7, 0x2f, 0xd4, 0xca,
+    0x31, 0x47, 0x38, 0x9f, 0x51, 0xbb, 0xf0, 0x27, 0x75, 0x77, 0x0e, 0x4d, 0xd0, 0x5e, 0x4b, 0xdb,
+    0x62, 0xb4, 0x28, 0x52, 0xa0, 0x87, 0xf9, 0x26, 0xbc, 0xa0, 0x0d, 0xb2, 0x21, 0x4d, 0xd4, 0x24,
+    0xd2, 0x19, 0xc1, 0x23, 0xad, 0x36, 0xf0, 0x80, 0x71, 0x8e, 0x32, 0xc7, 0x2c, 0x4e, 0xc1, 0x55,
+    0xab, 0xb2, 0x07, 0x10, 0x34, 0x53, 0x95, 0xdb, 0x14, 0xe4, 0x52, 0x1e, 0x7d, 0x43, 0x2a, 0x4b,
+    0xe6, 0x03, 0x89, 0xcf, 0xf8, 0x48, 0x20, 0xfd, 0x74, 0xb3, 0x45, 0x6e, 0x41, 0x42, 0x35, 0x3a,
+    0xc6, 0x6d, 0x1d, 0xe9, 0xaa, 0xa3, 0xb8, 0x50, 0x32, 0x98, 0xb1, 0xc3, 0x6d, 0x72, 0xc1, 0x42,
+    0xc6, 0x10, 0x64, 0xc0, 0x64, 0xef, 0x6b, 0xe9, 0x69, 0xfc, 0xa2, 0x55, 0x41, 0x87, 0x31, 0x75,
+    0x73, 0xd0, 0x8e, 0x4c, 0x5a, 0xab, 0x32, 0xc1, 0x46, 0x63, 0x55, 0x6c, 0xb2, 0xd4, 0x93, 0xf4,
+    0x16, 0xaa, 0x72, 0x81, 0xa9, 0xb6, 0xf7, 0x32, 0x7d, 0x22, 0xef, 0xa3, 0x85, 0x4b, 0x53, 0x69,
+    0xa1, 0xbe, 0xaa, 0xba, 0x9b, 0x1f, 0x34, 0xf8, 0xe0, 0x15, 0x1a, 0xce, 0x38, 0x3f, 0xae, 0x88,
+    0x39, 0x52, 0x63, 0x33, 0x84, 0x3d, 0x85, 0xdb, 0x29, 0x5d, 0x83, 0xcf, 0x4c, 0xa6, 0x11, 0x22,
+    0x09, 0x56, 0x12, 0x85, 0x2b, 0x5d, 0xfd, 0x4e, 0x93, 0x4c, 0x40, 0x16, 0x66, 0x32, 0x64, 0x7f,
+    0x69, 0x47, 0x12, 0xd4, 0x55, 0x18, 0x0a, 0xa7, 0xfb, 0x4b, 0x4e, 0x32, 0x32, 0xbf, 0xa6, 0xcb,
+    0x9c, 0x3a, 0xd8, 0x3d, 0x9e, 0x24, 0x1b, 0xd0, 0x4b, 0xb5, 0xb7, 0x26, 0x1a, 0x06, 0x7f, 0x15,
+    0x2f, 0xd9, 0xd7, 0x26, 0x7b, 0x83, 0x8c, 0xef, 0xa9, 0xde, 0x10, 0x21, 0xea, 0x7b, 0x06, 0x50,
+    0x1e, 0x35, 0xf0, 0x96, 0xd4, 0x66, 0xad, 0xca, 0x50, 0x30, 0xc1, 0xd1, 0x73, 0x07, 0x07, 0xf2,
+    0xd9, 0x7a, 0xeb, 0xeb, 0x10, 0x58, 0x49, 0xac, 0x9f, 0x80, 0x17, 0x70, 0x4c, 0x8d, 0x41, 0x1e,
+    0x89, 0x7b, 0xa5, 0xa6, 0xf3, 0x32, 0x5c, 0xa5, 0xb4, 0x02, 0x07, 0x4b, 0x89, 0xa5, 0xd5, 0xa1,
+    0x0d, 0xb8, 0x43, 0xa8, 0x7d, 0x75, 0x55, 0x85, 0x93, 0x23, 0x6c, 0x76, 0xe6, 0xe8, 0x9b, 0x2b,
+    0x7b, 0xa4, 0x91, 0x32, 0xdf, 0x3a, 0xcb, 0xd7, 0x58, 0x8d, 0xbb, 0x2d, 0x09, 0x19, 0x66, 0x3c,
+    0x59, 0xcc, 0x66, 0xab, 0xa9, 0x06, 0x2d, 0x6c, 0xb5, 0xb0, 0x2c, 0xfa, 0x14, 0x2e, 0x9a, 0x36,
+    0x6f, 0x5d, 0x3f, 0x55, 0x57, 0x5d, 0xe9, 0x21, 0xdb, 0x30, 0x45, 0xb1, 0x81, 0x73, 0x7f, 0x36,
+    0xca, 0xd9, 0x5c, 0xa2, 0x68, 0xbc, 0x75, 0x73, 0x94, 0xfd, 0xfa, 0xad, 0x15, 0x4d, 0xfc, 0x4f,
+    0x0e, 0xbb, 0x79, 0x7d, 0x0b, 0xde, 0x88, 0x0c, 0x2d, 0x92, 0x0f, 0xe3, 0x54, 0xc7, 0x75, 0xf7,
+    0xdf, 0x7e, 0x0d, 0x0c, 0x2e, 0xb1, 0x76, 0x52, 0x29, 0x57, 0x45, 0xe5, 0x74, 0xc9, 0x86, 0xb2,
+    0x44, 0xf2, 0xe4, 0xf1, 0xe7, 0x74, 0x5a, 0xed, 0x27, 0x33, 0x4e, 0x3a, 0x58, 0x05, 0x93, 0x74,
+    0x04, 0xba, 0xf7, 0x61, 0xba, 0xbd, 0x3d, 0x0c, 0x92, 0x96, 0x63, 0xb5, 0x9c, 0xb2, 0xd7, 0x54,
+    0xd8, 0x9f, 0x9d, 0x4d, 0xff, 0x00, 0x9c, 0xc0, 0xbb, 0x81,
+};
+
+// zlib stream holding `data` in one stored (uncompressed) block
+std::vector<uint8_t> stored_zlib(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> z = {0x78, 0x01, 0x01};
+    const uint16_t len = static_cast<uint16_t>(data.size());
+    z.insert(z.end(), {static_cast<uint8_t>(len), static_cast<uint8_t>(len >> 8),
+                       static_cast<uint8_t>(~len), static_cast<uint8_t>(~len >> 8)});
+    z.insert(z.end(), data.begin(), data.end());
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : data) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    write_be32(z, (b << 16) | a);
+    return z;
+}
+
+std::vector<uint8_t> make_ihdr(int width, int height, uint8_t color_type) {
+    std::vector<uint8_t> ihdr;
+    write_be32(ihdr, static_cast<uint32_t>(width));
+    write_be32(ihdr, static_cast<uint32_t>(height));
+    ihdr.insert(ihdr.end(), {8, color_type, 0, 0, 0});
+    return ihdr;
+}
+
+void check_damaged(const std::vector<uint8_t>& ihdr, const std::vector<uint8_t>& idat, int width, int height,
+                   int channels, std::mt19937& rng) {
+    ImageData decoded;
+    check(decode(build_png(ihdr, idat), decoded) && decoded.width == width && decoded.height == height,
+          "intact decode", channels);
+
+    // Truncated streams, re-wrapped in valid chunks so the inflater sees them
+    // (cuts in the Adler-32 trailer alone leave a complete deflate stream)
+    for (size_t keep = 2; keep < idat.size() - 4; keep += 1 + keep / 32) {
+        std::vector<uint8_t> cut(idat.begin(), idat.begin() + keep);
+        ImageData out;
+        const std::vector<uint8_t> png = build_png(ihdr, cut);
+        check(!decode(png, out), "truncated stream rejected", keep);
+        check(!out.is_valid(), "truncated stream leaves no image", keep);
+        check(!ImageProcessor::decode_image(png.data(), png.size()).is_valid(), "truncated stream fails decode_image", keep);
+    }
+
+    // Files cut short, as a partial copy leaves them (no IEND, torn chunk)
+    const std::vector<uint8_t> whole = build_png(ihdr, idat);
+    for (size_t keep = 8; keep < whole.size() - 12; keep += 1 + keep / 16) {
+        std::vector<uint8_t> cut(whole.begin(), whole.begin() + keep);
+        cut.shrink_to_fit();
+        check(!ImageProcessor::decode_image(cut.data(), cut.size()).is_valid(), "truncated file fails decode_image", keep);
+    }
+
+    // Reserved block type (BTYPE = 3) in the first deflate block
+    {
+        std::vector<uint8_t> bad = idat;
+        bad[2] |= 0x06;
+        ImageData out;
+        check(!decode(build_png(ihdr, bad), out), "reserved block type rejected", channels);
+    }
+
+    // Random bit flips: without a checksum some still inflate, but the
+    // result must then be complete
+    for (int i = 0; i < 2000; ++i) {
+        std::vector<uint8_t> bad = idat;
+        const size_t bit = 16 + rng() % ((bad.size() - 2) * 8);
+        bad[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+        ImageData out;
+        if (decode(build_png(ihdr, bad), out)) {
+            check(out.width == width && out.height == height && out.channels == channels, "flipped stream size", bit);
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(7);
+
+    const std::vector<uint8_t> sparse(SPARSE_GRAY_32, SPARSE_GRAY_32 + sizeof(SPARSE_GRAY_32));
+    check_damaged(make_ihdr(32, 32, 0), sparse, 32, 32, 1, rng);
+
+    // Noise with smooth regions from our own encoder
+    const int width = 256;
+    const int height = 128;
+    for (int channels : {1, 3, 4}) {
+        ImageData image = ImageData::allocate(width, height, channels);
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = image.row(y);
+            for (int x = 0; x < width * channels; ++x) {
+                row[x] = (x / 16 + y / 8) % 3 == 0 ? static_cast<uint8_t>(rng()) : static_cast<uint8_t>(x + y);
+            }
+        }
+        std::vector<uint8_t> png;
+        ImageProcessor::encode_png(image, png);
+        std::vector<uint8_t> ihdr, idat;
+        check(split_png(png, ihdr, idat), "split", channels);
+        if (idat.size() >= 16) check_damaged(ihdr, idat, width, height, channels, rng);
+    }
+
+    // Palette indices past the PLTE entries decode as opaque black
+    {
+        const uint8_t row[] = {0, 0, 1, 200, 255};  // Filter 0, then 4 indices
+        std::vector<uint8_t> rows;
+        for (int y = 0; y < 4; ++y) rows.insert(rows.end(), row, row + sizeof(row));
+        const uint8_t plte[] = {10, 20, 30, 40, 50, 60};
+        const std::vector<uint8_t> ihdr = make_ihdr(4, 4, 3);
+        std::vector<uint8_t> png = build_png(ihdr, {});
+        png.resize(8 + 12 + ihdr.size());  // Signature and IHDR only
+        append_chunk(png, "PLTE", plte, sizeof(plte));
+        const std::vector<uint8_t> idat = stored_zlib(rows);
+        append_chunk(png, "IDAT", idat.data(), idat.size());
+        append_chunk(png, "IEND", nullptr, 0);
+        ImageData out;
+        check(decode(png, out) && out.channels == 3, "palette decode", 0);
+        if (out.is_valid()) {
+            const uint8_t expected[12] = {10, 20, 30, 40, 50, 60, 0, 0, 0, 0, 0, 0};
+            for (int y = 0; y < 4; ++y) {
+                check(std::equal(expected, expected + 12, out.row(y)), "out-of-range palette index is black", y);
+            }
+        }
+    }
+
+    if (failures) {
+        std::fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    std::printf("png_decoder_test: ok\n");
+    return 0;
+}